@@ -0,0 +1,181 @@
+#ifndef ARROWWRITER
+#define ARROWWRITER
+
+#include <stdio.h>
+#include <vector>
+#include "TString.h"
+
+#ifdef HAVE_ARROW
+#include <memory>
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/writer.h>
+#endif
+
+using namespace std;
+
+/// Write the built events as an Apache Arrow IPC stream ( .arrows ), for the python analysis,
+/// pyarrow.ipc.open_stream("run.arrows").read_all(). One record batch per batch of events of
+/// FileIO, i.e. per update period, one row per event, with list columns of the hits,
+///   ch list<uint8>, e list<uint32>, t list<uint64>, tf list<uint16>
+/// all sharing the same event offsets, hit k of event i is at offset[i] + k. The schema metadata
+/// has nChannel and ch2ns. The stream format needs no footer, a file cut by a crash is readable
+/// up to the last batch.
+/// Needs the Arrow C++ library, make ARROW=1, otherwise the writer is never open.
+
+class ArrowWriter{
+public:
+
+  ArrowWriter(TString fileName, int nChannel, int ch2ns);
+  ~ArrowWriter();
+
+  bool IsOpen() {return isOpen;}
+  TString GetFileName() {return fileName;}
+
+  /// nEvent x nChannel, channel indexed, channel[ch] < 0 = no hit, as FileIO::FillTree
+  void Write(int nEvent, int nChannel, int * channel, UInt_t * energy, ULong64_t * timeStamp, UShort_t * fineTime);
+  void Close();
+
+  void PrintStatistic();
+
+private:
+
+  TString fileName;
+  bool isOpen;
+  int nChannel;
+
+  ULong64_t writtenEvent;
+  ULong64_t writtenHit;
+  int writtenBatch;
+  int writeError;
+
+#ifdef HAVE_ARROW
+  shared_ptr<arrow::Schema> schema;
+  shared_ptr<arrow::io::FileOutputStream> stream;
+  shared_ptr<arrow::ipc::RecordBatchWriter> writer;
+
+  bool Check(const arrow::Status &status, const char * what);
+#endif
+};
+
+ArrowWriter::ArrowWriter(TString fileName, int nChannel, int ch2ns){
+
+  this->fileName = fileName;
+  this->nChannel = nChannel;
+  isOpen = false;
+  writtenEvent = 0;
+  writtenHit = 0;
+  writtenBatch = 0;
+  writeError = 0;
+
+#ifdef HAVE_ARROW
+  arrow::FieldVector fields = {
+    arrow::field("ch", arrow::list(arrow::uint8())),
+    arrow::field("e",  arrow::list(arrow::uint32())),
+    arrow::field("t",  arrow::list(arrow::uint64())),
+    arrow::field("tf", arrow::list(arrow::uint16()))
+  };
+  schema = arrow::schema(fields, arrow::key_value_metadata({"nChannel", "ch2ns"}, {to_string(nChannel), to_string(ch2ns)}));
+
+  arrow::Result<shared_ptr<arrow::io::FileOutputStream>> streamResult = arrow::io::FileOutputStream::Open(fileName.Data());
+  if( !Check(streamResult.status(), "open") ) return;
+  stream = *streamResult;
+
+  arrow::Result<shared_ptr<arrow::ipc::RecordBatchWriter>> writerResult = arrow::ipc::MakeStreamWriter(stream, schema);
+  if( !Check(writerResult.status(), "schema") ) return;
+  writer = *writerResult;
+
+  isOpen = true;
+  printf("====== Arrow writer started : %s\n", fileName.Data());
+#else
+  printf("====== Arrow output %s is not written, BoxScore was built without Apache Arrow (make ARROW=1).\n", fileName.Data());
+#endif
+}
+
+ArrowWriter::~ArrowWriter(){
+  Close();
+}
+
+#ifdef HAVE_ARROW
+bool ArrowWriter::Check(const arrow::Status &status, const char * what){
+  if( status.ok() ) return true;
+  if( writeError == 0 ) printf("Arrow file %s : %s, %s\n", fileName.Data(), what, status.ToString().c_str());
+  writeError ++;
+  return false;
+}
+#endif
+
+void ArrowWriter::Write(int nEvent, int nChannel, int * channel, UInt_t * energy, ULong64_t * timeStamp, UShort_t * fineTime){
+  if( !isOpen || nEvent <= 0 ) return;
+
+#ifdef HAVE_ARROW
+  arrow::Int32Builder offsetBuilder;
+  arrow::UInt8Builder chBuilder;
+  arrow::UInt32Builder eBuilder;
+  arrow::UInt64Builder tBuilder;
+  arrow::UInt16Builder tfBuilder;
+
+  int nHit = 0;
+  for( int i = 0; i < nEvent * nChannel; i++) if( channel[i] >= 0 ) nHit ++;
+  if( !Check(offsetBuilder.Reserve(nEvent + 1), "reserve") ) return;
+  if( !Check(chBuilder.Reserve(nHit), "reserve") ) return;
+  if( !Check(eBuilder.Reserve(nHit), "reserve") ) return;
+  if( !Check(tBuilder.Reserve(nHit), "reserve") ) return;
+  if( !Check(tfBuilder.Reserve(nHit), "reserve") ) return;
+
+  int offset = 0;
+  for( int ev = 0; ev < nEvent; ev++){
+    offsetBuilder.UnsafeAppend(offset);
+    for( int ch = 0; ch < nChannel; ch++){
+      int k = ev * nChannel + ch;
+      if( channel[k] < 0 ) continue;
+      chBuilder.UnsafeAppend(ch);
+      eBuilder.UnsafeAppend(energy[k]);
+      tBuilder.UnsafeAppend(timeStamp[k]);
+      tfBuilder.UnsafeAppend(fineTime == NULL ? 0 : fineTime[k]);
+      offset ++;
+    }
+  }
+  offsetBuilder.UnsafeAppend(offset);
+
+  shared_ptr<arrow::Array> offsets, ch, e, t, tf;
+  if( !Check(offsetBuilder.Finish(&offsets), "offsets") ) return;
+  if( !Check(chBuilder.Finish(&ch), "ch") ) return;
+  if( !Check(eBuilder.Finish(&e), "e") ) return;
+  if( !Check(tBuilder.Finish(&t), "t") ) return;
+  if( !Check(tfBuilder.Finish(&tf), "tf") ) return;
+
+  vector<shared_ptr<arrow::Array>> columns;
+  shared_ptr<arrow::Array> values[4] = {ch, e, t, tf};
+  for( int i = 0; i < 4; i++){
+    arrow::Result<shared_ptr<arrow::ListArray>> list = arrow::ListArray::FromArrays(*offsets, *values[i]);
+    if( !Check(list.status(), "list") ) return;
+    columns.push_back(*list);
+  }
+
+  shared_ptr<arrow::RecordBatch> batch = arrow::RecordBatch::Make(schema, nEvent, columns);
+  if( !Check(writer->WriteRecordBatch(*batch), "write") ) return;
+
+  writtenEvent += nEvent;
+  writtenHit += nHit;
+  writtenBatch ++;
+#endif
+}
+
+void ArrowWriter::Close(){
+  if( !isOpen ) return;
+#ifdef HAVE_ARROW
+  Check(writer->Close(), "close");
+  Check(stream->Close(), "close");
+#endif
+  isOpen = false;
+  printf("====== Arrow writer stopped : %s, %d batches, %llu events, %llu hits\n", fileName.Data(), writtenBatch, writtenEvent, writtenHit);
+}
+
+void ArrowWriter::PrintStatistic(){
+  printf(" Arrow %s | %6d batches | %12llu events | %12llu hits", isOpen ? "(on) " : "(off)", writtenBatch, writtenEvent, writtenHit);
+  if( writeError > 0 ) printf(" | %d errors", writeError);
+  printf("\n");
+}
+
+#endif
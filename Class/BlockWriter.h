@@ -0,0 +1,306 @@
+#ifndef BLOCKWRITER
+#define BLOCKWRITER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ctime>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "TString.h"
+
+using namespace std;
+
+#define BlockAlign 4096   /// buffer, size and file offset alignment, for O_DIRECT
+
+/// Write large aligned blocks of a binary stream ( raw hits, ... ) to a file, from its own thread.
+/// A small pool of nBuffer aligned buffers, the producer takes a free one with GetBuffer(), fills it
+/// and hands it back with Submit(). When all are in flight and the disk falls behind, the pool grows
+/// one buffer at a time up to maxBuffer, then GetBuffer() returns NULL instead of waiting.
+/// The file extents are reserved ahead with fallocate, preallocMB at a time, so the file does not grow
+/// one write at a time, the unused part is released at Close(). With directIO the file is opened with
+/// O_DIRECT and the page cache is bypassed, it falls back to normal writes when the file system does
+/// not support it. The throughput and the worst write() latency are kept.
+
+class BlockWriter{
+public:
+
+  BlockWriter(TString fileName, size_t blockSize, int nBuffer = 8, int maxBuffer = 0, bool directIO = false, double preallocMB = 256); /// maxBuffer 0 = nBuffer
+  ~BlockWriter();
+
+  bool IsOpen()                 {return fd >= 0;}
+  bool IsDirectIO()             {return isDirect;}
+  TString GetFileName()         {return fileName;}
+  size_t GetBlockSize()         {return blockSize;}
+
+  bool   WriteHeader(const void * data, size_t size); /// before any Submit, padded to BlockAlign
+  char * GetBuffer();                                 /// aligned, blockSize, NULL if none is free
+  void   Submit(char * buffer, size_t size);          /// size is rounded up to BlockAlign, zero padded
+  void   Release(char * buffer);                      /// back to the pool, not written
+  void   Drain();                                     /// wait until every submitted buffer is on disk
+  void   Close();
+
+  double GetFileSizeMB();
+  int    GetWriteError();
+  void   PrintStatistic(const char * name);
+
+private:
+
+  TString fileName;
+  int fd;
+  bool isDirect;
+  size_t blockSize;
+  int nBuffer;                /// preallocated
+  int maxBuffer;              /// allocated when needed, up to
+
+  Long64_t preallocByte;      /// 0 = off
+  Long64_t allocatedByte;     /// reserved up to
+  Long64_t fileByte;          /// written, the file offset
+
+  mutex queueMutex;
+  condition_variable queueCond;
+  condition_variable drainCond;
+  deque<pair<char *, size_t> > queue;
+  vector<char *> pool;
+  vector<char *> allBuffer;
+  bool writerStop;
+  bool writerBusy;
+  thread writer;
+
+  ///===== statistic, under queueMutex
+  int maxQueueDepth;
+  int writeError;
+  double writeSec;            /// time in write()
+  double maxLatencyMs;        /// worst write() of the run
+  double periodMaxLatencyMs;  /// since the last print
+  time_t lastPrintTime;
+  Long64_t lastPrintByte;
+
+  void WriterLoop();
+  bool WriteAll(const char * data, size_t size);
+  void Preallocate(Long64_t upTo);
+};
+
+BlockWriter::BlockWriter(TString fileName, size_t blockSize, int nBuffer, int maxBuffer, bool directIO, double preallocMB){
+
+  this->fileName = fileName;
+  this->blockSize = (blockSize + BlockAlign - 1) / BlockAlign * BlockAlign;
+  this->nBuffer = nBuffer < 2 ? 2 : nBuffer;
+  this->maxBuffer = maxBuffer < this->nBuffer ? this->nBuffer : maxBuffer;
+  isDirect = false;
+  preallocByte = preallocMB > 0 ? (Long64_t) (preallocMB * 1024 * 1024) / BlockAlign * BlockAlign : 0;
+  allocatedByte = 0;
+  fileByte = 0;
+
+  writerStop = false;
+  writerBusy = false;
+  maxQueueDepth = 0;
+  writeError = 0;
+  writeSec = 0;
+  maxLatencyMs = 0;
+  periodMaxLatencyMs = 0;
+  lastPrintTime = time(NULL);
+  lastPrintByte = 0;
+
+  fd = -1;
+#ifdef O_DIRECT
+  if( directIO ){
+    fd = open(fileName.Data(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if( fd >= 0 ) {
+      isDirect = true;
+    }else{
+      printf("%s : O_DIRECT not supported ( %s ), normal writes.\n", fileName.Data(), strerror(errno));
+    }
+  }
+#endif
+  if( fd < 0 ) fd = open(fileName.Data(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if( fd < 0 ){
+    printf("cannot open %s : %s\n", fileName.Data(), strerror(errno));
+    return;
+  }
+
+  for( int i = 0; i < this->nBuffer; i++){
+    void * buf = NULL;
+    if( posix_memalign(&buf, BlockAlign, this->blockSize) != 0 ) break;
+    allBuffer.push_back((char *) buf);
+    pool.push_back((char *) buf);
+  }
+
+  writer = thread(&BlockWriter::WriterLoop, this);
+}
+
+BlockWriter::~BlockWriter(){
+  Close();
+  for( int i = 0; i < (int) allBuffer.size(); i++) free(allBuffer[i]);
+  allBuffer.clear();
+  pool.clear();
+}
+
+void BlockWriter::Preallocate(Long64_t upTo){
+  if( preallocByte <= 0 || upTo <= allocatedByte ) return;
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+  Long64_t length = (upTo - allocatedByte + preallocByte - 1) / preallocByte * preallocByte;
+  if( fallocate(fd, FALLOC_FL_KEEP_SIZE, allocatedByte, length) == 0 ){
+    allocatedByte += length;
+    return;
+  }
+  printf("%s : no preallocation ( %s ).\n", fileName.Data(), strerror(errno));
+#endif
+  preallocByte = 0; /// not supported, do not try again
+}
+
+bool BlockWriter::WriteAll(const char * data, size_t size){
+  Preallocate(fileByte + size);
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+  size_t left = size;
+  while( left > 0 ){
+    ssize_t n = write(fd, data, left);
+    if( n < 0 ){
+      if( errno == EINTR ) continue;
+      return false;
+    }
+    data += n;
+    left -= n;
+  }
+  double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+
+  lock_guard<mutex> lock(queueMutex);
+  fileByte += size;
+  writeSec += ms / 1000.;
+  if( ms > maxLatencyMs ) maxLatencyMs = ms;
+  if( ms > periodMaxLatencyMs ) periodMaxLatencyMs = ms;
+  return true;
+}
+
+bool BlockWriter::WriteHeader(const void * data, size_t size){
+  if( fd < 0 ) return false;
+  char * buf = GetBuffer();
+  size_t bytes = (size + BlockAlign - 1) / BlockAlign * BlockAlign;
+  if( buf == NULL || bytes > blockSize ) {
+    if( buf != NULL ) Release(buf);
+    return false;
+  }
+  memset(buf, 0, bytes);
+  memcpy(buf, data, size);
+  Submit(buf, bytes);
+  Drain();
+  return GetWriteError() == 0;
+}
+
+char * BlockWriter::GetBuffer(){
+  lock_guard<mutex> lock(queueMutex);
+  if( pool.empty() && (int) allBuffer.size() < maxBuffer ){ /// the writer is behind, one more buffer
+    void * buf = NULL;
+    if( posix_memalign(&buf, BlockAlign, blockSize) == 0 ){
+      allBuffer.push_back((char *) buf);
+      return (char *) buf;
+    }
+  }
+  if( pool.empty() ) return NULL; /// all in flight, the producer decides
+  char * buf = pool.back();
+  pool.pop_back();
+  return buf;
+}
+
+void BlockWriter::Release(char * buffer){
+  lock_guard<mutex> lock(queueMutex);
+  pool.push_back(buffer);
+}
+
+void BlockWriter::Submit(char * buffer, size_t size){
+  size_t bytes = (size + BlockAlign - 1) / BlockAlign * BlockAlign;
+  if( bytes > blockSize ) bytes = blockSize;
+  if( bytes > size ) memset(buffer + size, 0, bytes - size);
+  {
+    lock_guard<mutex> lock(queueMutex);
+    queue.push_back(make_pair(buffer, bytes));
+    if( (int) queue.size() > maxQueueDepth ) maxQueueDepth = queue.size();
+  }
+  queueCond.notify_one();
+}
+
+void BlockWriter::Drain(){
+  if( fd < 0 ) return;
+  unique_lock<mutex> lock(queueMutex);
+  drainCond.wait(lock, [this]{ return queue.empty() && !writerBusy; });
+}
+
+void BlockWriter::Close(){
+  if( fd < 0 ) return;
+  {
+    lock_guard<mutex> lock(queueMutex);
+    writerStop = true;
+  }
+  queueCond.notify_all();
+  writer.join();
+  if( allocatedByte > fileByte && ftruncate(fd, fileByte) != 0 ) { /// release the reserved, unused extents
+    printf("%s : cannot truncate the preallocation, %s\n", fileName.Data(), strerror(errno));
+  }
+  close(fd);
+  fd = -1;
+}
+
+void BlockWriter::WriterLoop(){
+
+  while( true ){
+    pair<char *, size_t> block;
+    {
+      unique_lock<mutex> lock(queueMutex);
+      queueCond.wait(lock, [this]{ return !queue.empty() || writerStop; });
+      if( queue.empty() ) break; /// stop and nothing left
+      block = queue.front();
+      queue.pop_front();
+      writerBusy = true;
+    }
+
+    bool ok = WriteAll(block.first, block.second);
+
+    {
+      lock_guard<mutex> lock(queueMutex);
+      if( !ok ){
+        if( writeError == 0 ) printf("%s : write error %s\n", fileName.Data(), strerror(errno));
+        writeError ++;
+      }
+      pool.push_back(block.first);
+      writerBusy = false;
+    }
+    drainCond.notify_all();
+  }
+
+  drainCond.notify_all();
+}
+
+double BlockWriter::GetFileSizeMB(){
+  lock_guard<mutex> lock(queueMutex);
+  return fileByte / 1024. / 1024.;
+}
+
+int BlockWriter::GetWriteError(){
+  lock_guard<mutex> lock(queueMutex);
+  return writeError;
+}
+
+void BlockWriter::PrintStatistic(const char * name){
+  lock_guard<mutex> lock(queueMutex);
+  time_t now = time(NULL);
+  double dt = difftime(now, lastPrintTime);
+  if( dt <= 0 ) dt = 1;
+  printf(" %-9s %s | queue %2d/%2d/%2d (max %2d) | %8.1f MB | %7.2f MB/s ( %7.1f MB/s in write ) | latency max %6.1f ms ( run %6.1f ms )",
+           name, isDirect ? "(direct)" : "(cached)", (int) queue.size(), (int) allBuffer.size(), maxBuffer, maxQueueDepth, fileByte / 1024. / 1024.,
+           (fileByte - lastPrintByte) / 1024. / 1024. / dt, writeSec > 0 ? fileByte / 1024. / 1024. / writeSec : 0.,
+           periodMaxLatencyMs, maxLatencyMs);
+  if( writeError > 0 ) printf(" | %d write errors", writeError);
+  printf("\n");
+  lastPrintTime = now;
+  lastPrintByte = fileByte;
+  periodMaxLatencyMs = 0;
+}
+
+#endif
@@ -16,6 +16,7 @@
 #include <cmath>
 #include <vector>
 #include <bitset>
+#include <algorithm>
 #include <unistd.h>
 #include <limits.h>
 #include <ctime>
@@ -24,6 +25,12 @@
 
 #define MaxNChannels 16
 #define MaxDataAShot 100000 /// also limited by Timing, channel, energy pointer initialization.
+#define FineTimeBits 10      /// fine time stamp in Extras2[9:0], 1 ch = 2^10 fine-ch
+
+#include "LatencyMonitor.h"
+#include "RateMonitor.h"
+#include "LiveTime.h"
+#include "RawHitWriter.h"
 
 using namespace std;
 
@@ -110,6 +117,7 @@ string   GetAcqMode()                 { return AcqMode == 1  ?  "list" :  "mixed
   int16_t** GetWaveForms1()             { return WaveLine1;}
   int16_t** GetWaveForms2()             { return WaveLine2;}
   uint8_t** GetDigitialWaveForms()       { return DigitalWaveLine;}
+  uint*     GetPreTriggerSizes()        { return PreTriggerSize;}  /// samples
 
   int      Getch2ns()     {return ch2ns;}
   int      GetCoincidentTimeWindow()    {return CoincidentTimeWindow;}
@@ -121,6 +129,33 @@ string   GetAcqMode()                 { return AcqMode == 1  ?  "list" :  "mixed
   float    GetScaleFactor()             {return ScaleFactor;}
   float    GetPrimBeamCurrent()        {return PrimBeamCurrent;}
 
+  bool     IsFilePersistent()           {return isFilePersistent;}
+  double   GetFileAutoSaveSec()         {return fileAutoSaveSec;}
+  double   GetFileAutoSaveMB()          {return fileAutoSaveMB;}
+  double   GetRolloverMB()              {return isFileRollover ? rolloverMB : 0;}
+  double   GetRolloverSec()             {return isFileRollover ? rolloverSec : 0;}
+  double   GetSnapshotSec()             {return isFileSnapshot ? snapshotSec : 0;}
+  int      GetArrowOutput()             {return arrowOutput;}
+  bool     IsWritePolicy()              {return isWritePolicy;}
+  int      GetPolicyQueueMark(int i)    {return policyQueueMark[i];}  /// 0 drop waves, 1 prescale singles, 2 no histograms
+  double   GetPolicyDiskMark(int i)     {return policyDiskMark[i];}
+  int      GetPolicyPrescale()          {return policyPrescale;}
+  double   GetCheckpointSec()           {return isHistCheckpoint ? checkpointSec : 0;}
+  bool     IsTreeCompact()              {return isTreeCompact;}
+  bool     IsTreeDeltaTime()            {return isTreeDeltaTime;}
+  bool     IsTreeWave()                 {return isTreeWave;}
+  int      GetTreeWaveLayout()          {return treeWaveLayout;}
+  int      GetCompressionAlgorithm()    {return compAlgorithm;}
+  int      GetCompressionLevel()        {return compLevel;}
+  int      GetBasketSize()              {return basketSize;}
+  double   GetAutoFlushMB()             {return autoFlushMB;}
+  int      GetImplicitMTThreads()       {return implicitMT;}
+  bool     IsSaveRawHit()               {return isSaveRawHit;}
+  int      GetRawBlockSizeMB()          {return rawBlockSizeMB;}
+  bool     IsRawDirectIO()              {return isRawDirectIO;}
+  int      GetRawBufferCount()          {return rawBufferCount;}
+  double   GetRawPreallocMB()           {return rawPreallocMB;}
+
 
   uint32_t GetChannelMask() const       {return ChannelMask;}
   string   GetChannelMaskString();
@@ -131,6 +166,8 @@ string   GetAcqMode()                 { return AcqMode == 1  ?  "list" :  "mixed
 
   ///======== Get Raw Data
   int          GetNumRawEvent()       {return rawEvCount + rawEvLeftCount;}
+  int          GetBuildScratchSize()  {return scratchSize;}   /// capacity in hits
+  size_t       GetBuildScratchBytes() {return (size_t) scratchSize * ScratchBytesPerHit();}
   ULong64_t *  GetRawTimeStamp()      {return rawTimeStamp;}
   UInt_t*      GetRawEnergy()         {return rawEnergy;}
   int *        GetRawChannel()        {return rawChannel;}
@@ -138,6 +175,11 @@ string   GetAcqMode()                 { return AcqMode == 1  ?  "list" :  "mixed
   ULong64_t    GetRawTimeStamp(int i) {return rawTimeStamp[i];}
   UInt_t       GetRawEnergy(int i)    {return rawEnergy[i];}
   int          GetRawChannel(int i)   {return rawChannel[i];}
+  UShort_t *   GetRawFineTime()       {return rawFineTime;}
+  UShort_t     GetRawFineTime(int i)  {return rawFineTime[i];}
+  ULong64_t    GetRawTimeStampHR(int i) {return (rawTimeStamp[i] << FineTimeBits) + rawFineTime[i];} /// in fine-ch
+  ULong64_t    HRDiff(int i, int j) {ULong64_t a = GetRawTimeStampHR(i), b = GetRawTimeStampHR(j); return b > a ? b - a : 0;} /// fine-ch from hit i to hit j, 0 when j is not later, never wraps
+  ULong64_t    GetRawReadTime(int i)  {return rawReadTime[i];} /// in us, LatencyMonitor::NowMicroSec()
 
   void ClearRawData(); /// clear Raw Data and set rawEvCount = 0;
   void ClearData();    /// clear built event vectors, and set countEventBuild =  0;
@@ -150,6 +192,18 @@ string   GetAcqMode()                 { return AcqMode == 1  ?  "list" :  "mixed
   int * GetNChannelEventCount()         {return countNChannelEvent;}
   int   GetTotalNChannelEvent(int Nch)  {return totNChannelEvent[Nch-1];}
 
+  ///======== Rates from time stamps, iWin = 0, 1, 2 for the windows in generalSetting.txt
+  void   SetNChannelForRealEvent(int n)  {nChannelForRealEvent = n;}
+  double GetRateWindow(int iWin)         {return rateMonitor->GetWindow(iWin);}
+  double GetChannelRate(int ch, int iWin){return rateMonitor->GetRate(ch, iWin);}
+  double GetRealEventRate(int iWin)      {return rateMonitor->GetRate(MaxNChannels, iWin);} /// events with nChannelForRealEvent hits
+
+  ///======== Dead-time and live-time, list mode only
+  LiveTime * GetLiveTime()              {return liveTime;}
+
+  void   SetRawHitWriter(RawHitWriter * writer) {rawHitWriter = writer;} /// every hit of ReadData() goes there, list mode only
+  RawHitFileHeader GetRawHitFileHeader();
+
   ///======== Get built event
   ULong64_t * GetTimeStamp(int ev)        {return TimeStamp[ev];}
   UInt_t *    GetEnergy(int ev)           {return Energy[ev];}
@@ -157,6 +211,12 @@ string   GetAcqMode()                 { return AcqMode == 1  ?  "list" :  "mixed
   ULong64_t   GetTimeStamp(int ev, int ch){return TimeStamp[ev][ch];}
   UInt_t      GetEnergy(int ev, int ch)   {return Energy[ev][ch];}
   int         GetChannel(int ev, int ch)  {return Channel[ev][ch];}
+  UShort_t *  GetFineTime(int ev)         {return FineTime[ev];}
+  UShort_t    GetFineTime(int ev, int ch) {return FineTime[ev][ch];}
+  ULong64_t   GetTimeStampHR(int ev, int ch){return (TimeStamp[ev][ch] << FineTimeBits) + FineTime[ev][ch];} /// in fine-ch
+  double      GetFineTimeToNanoSec()      {return ch2ns * 1.0 / (1 << FineTimeBits);}
+  ULong64_t   GetEventReadTime(int ev)    {return EventReadTime[ev];} /// in us, read-out time of the newest hit of the event
+  ULong64_t   GetEventEmitTime()          {return eventEmitTime;}     /// in us, when the last BuildEvent returned
 
   ///========= Digitizer Control
   int  ProgramDigitizer();
@@ -245,16 +305,54 @@ private:
   float ScaleFactor;
   float PrimBeamCurrent;
 
+  bool   isFilePersistent;  /// keep the root file open during the run
+  double fileAutoSaveSec;
+  double fileAutoSaveMB;
+  bool   isFileRollover;    /// split the run into segments, see FileIO::SetRollover
+  double rolloverMB;
+  double rolloverSec;
+  bool   isFileSnapshot;    /// follow mode, see FileIO::SetSnapshot
+  double snapshotSec;
+  int    arrowOutput;       /// 0 off, 1 alongside the tree, 2 instead of the tree, see ArrowWriter.h
+  bool   isWritePolicy;     /// degrade the output under disk pressure, see WritePolicy.h
+  int    policyQueueMark[3];
+  double policyDiskMark[3];
+  int    policyPrescale;
+  bool   isHistCheckpoint;  /// background copy of the histograms, see HistogramCheckpoint.h
+  double checkpointSec;
+  bool   isTreeCompact;     /// nHit + ch/e/t/tf[nHit] instead of [NChannel]
+  bool   isTreeDeltaTime;
+  bool   isTreeWave;        /// the wave branch, for the integrate-wave mode
+  int    treeWaveLayout;    /// 0 TObjArray of TGraph, 1 int16, 2 int16 delta, see FileIO::SetWaveLayout
+  int    compAlgorithm;     /// 1 ZLIB, 2 LZMA, 4 LZ4, 5 ZSTD, 0 ROOT default
+  int    compLevel;
+  int    basketSize;        /// byte, 0 = ROOT default
+  double autoFlushMB;       /// cluster size, 0 = AutoSave size or ROOT default
+  int    implicitMT;        /// threads for ROOT implicit MT, 0 = off
+  bool   isSaveRawHit;      /// raw hit stream, see RawHitFormat.h
+  int    rawBlockSizeMB;
+  bool   isRawDirectIO;     /// see BlockWriter.h
+  int    rawBufferCount;    /// most blocks in flight, 0 = RawHitMemoryMB of blocks
+  double rawPreallocMB;
+
   //==================== retreived data
   int ECnt[MaxNChannels];
   int TrgCnt[MaxNChannels];
   int PurCnt[MaxNChannels];
   int rawEvCount;
   int rawEvLeftCount;
+  int rawEvPending;   /// hits in the raw buffer that are not yet in a built event
+
+  RateMonitor * rateMonitor; /// slot 0 - 15 : channel triggers, slot MaxNChannels : real events
+  LiveTime * liveTime;
+  RawHitWriter * rawHitWriter;
+  int nChannelForRealEvent;
   uint64_t rawTimeRange;
 
   ///===== unsorted data
   ULong64_t* rawTimeStamp;
+  UShort_t* rawFineTime;   /// fine time stamp, 1 ch = 2^FineTimeBits fine-ch
+  ULong64_t* rawReadTime;  /// wall-clock of the read-out, in us
   UInt_t* rawEnergy;
   int* rawChannel;
 
@@ -266,6 +364,7 @@ private:
 
   ///==== data for single event
   ULong64_t * singleTimeStamp;
+  UShort_t * singleFineTime;
   UInt_t * singleEnergy;
   int * singleChannel;
 
@@ -273,6 +372,23 @@ private:
   int ** Channel;
   UInt_t ** Energy;
   ULong64_t ** TimeStamp;
+  UShort_t ** FineTime;
+  ULong64_t * EventReadTime;
+  ULong64_t eventEmitTime;
+
+  ///==== scratch arena for BuildEvent, grown to the high-water mark, freed only in destructor
+  int scratchSize;
+  int scratchGrowCount;
+  int      * scratchSortIndex;
+  ULong64_t* scratchSortTime;
+  int      * scratchChannel;
+  UInt_t   * scratchEnergy;
+  ULong64_t* scratchTimeStamp;
+  UShort_t * scratchFineTime;
+  ULong64_t* scratchReadTime;
+
+  void   ReserveBuildScratch(int nHit);
+  size_t ScratchBytesPerHit() { return sizeof(int) + sizeof(double) + sizeof(int) + sizeof(UInt_t) + sizeof(ULong64_t) + sizeof(UShort_t) + sizeof(ULong64_t);}
 
   string expName;
 
@@ -295,6 +411,54 @@ Digitizer::Digitizer(int ID, uint32_t ChannelMask, string expName){
   ch2ns    = 2; /// 1 channel = 2 ns
   Nb       = 0;
   CoincidentTimeWindow = 200; // nano-sec
+  isFilePersistent = false;
+  fileAutoSaveSec = 30;
+  fileAutoSaveMB = 100;
+  isFileRollover = false;
+  rolloverMB = 2000;
+  rolloverSec = 3600;
+  isFileSnapshot = false;
+  snapshotSec = 5;
+  arrowOutput = 0;
+  isWritePolicy = false;
+  policyQueueMark[0] = 4;
+  policyQueueMark[1] = 8;
+  policyQueueMark[2] = 16;
+  policyDiskMark[0] = 20;
+  policyDiskMark[1] = 10;
+  policyDiskMark[2] = 5;
+  policyPrescale = 10;
+  isHistCheckpoint = false;
+  checkpointSec = 30;
+  isTreeCompact = false;
+  isTreeDeltaTime = false;
+  isTreeWave = true;
+  treeWaveLayout = 0;
+  compAlgorithm = 0;
+  compLevel = -1;
+  basketSize = 0;
+  autoFlushMB = 0;
+  implicitMT = 0;
+  isSaveRawHit = false;
+  rawBlockSizeMB = 1;
+  isRawDirectIO = false;
+  rawBufferCount = 0;
+  rawPreallocMB = 256;
+
+  rateMonitor = new RateMonitor(MaxNChannels + 1);
+  nChannelForRealEvent = 1;
+  liveTime = new LiveTime();
+  rawHitWriter = NULL;
+
+  scratchSize      = 0;
+  scratchGrowCount = 0;
+  scratchSortIndex = NULL;
+  scratchSortTime  = NULL;
+  scratchChannel   = NULL;
+  scratchEnergy    = NULL;
+  scratchTimeStamp = NULL;
+  scratchFineTime  = NULL;
+  scratchReadTime  = NULL;
   for(int i = 0 ; i < MaxNChannels; i++ )waveformLength[i] = 0;
 
   ///----------------- default channel setting
@@ -435,23 +599,31 @@ Digitizer::Digitizer(int ID, uint32_t ChannelMask, string expName){
 
   rawEvCount= 0;
   rawEvLeftCount = 0;
+  rawEvPending = 0;
 
   rawTimeRange = 999999999999999;
 
   singleEnergy = new UInt_t[NChannel];
   singleChannel = new int[NChannel];
   singleTimeStamp = new ULong64_t [NChannel];
+  singleFineTime = new UShort_t [NChannel];
 
   rawTimeStamp = new ULong64_t [MaxDataAShot];
+  rawFineTime  = new UShort_t [MaxDataAShot];
+  rawReadTime  = new ULong64_t [MaxDataAShot];
   rawEnergy    = new UInt_t [MaxDataAShot];
   rawChannel   = new int [MaxDataAShot];
 
   TimeStamp = new ULong64_t * [MaxDataAShot];
+  FineTime  = new UShort_t * [MaxDataAShot];
   Energy    = new UInt_t * [MaxDataAShot];
   Channel   = new int * [MaxDataAShot];
+  EventReadTime = new ULong64_t [MaxDataAShot];
+  eventEmitTime = 0;
 
   for( int i = 0; i < MaxDataAShot ; i++){
     TimeStamp[i] = new ULong64_t [NChannel];
+    FineTime[i]  = new UShort_t [NChannel];
     Energy[i]    = new UInt_t [NChannel];
     Channel[i]   = new int [NChannel];
   }
@@ -494,13 +666,28 @@ Digitizer::~Digitizer(){
 	delete[] singleChannel;
 	delete[] singleEnergy;
 	delete[] singleTimeStamp;
+	delete[] singleFineTime;
 
 	delete[] rawChannel;
 	delete[] rawEnergy;
 	delete[] rawTimeStamp;
+	delete[] rawFineTime;
+	delete[] rawReadTime;
+	delete[] EventReadTime;
 
 	delete buffer;
   }
+
+  delete [] scratchSortIndex;
+  delete [] scratchSortTime;
+  delete [] scratchChannel;
+  delete [] scratchEnergy;
+  delete [] scratchTimeStamp;
+  delete [] scratchFineTime;
+  delete [] scratchReadTime;
+
+  delete rateMonitor;
+  delete liveTime;
 }
 
 int Digitizer::SetAcqMode(string mode, int recordLength = -1){
@@ -875,9 +1062,17 @@ int Digitizer::SetChannelParity(int ch, bool isPositive){
 }
 
 void Digitizer::ClearRawData(){
+  if( AcqMode != CAEN_DGTZ_DPP_ACQ_MODE_Mixed ) { /// hits that never reach the event builder
+    for( int i = 0; i < rawEvPending; i++){
+      if( rawChannel[i] >= 0 ) liveTime->AddDropped(rawChannel[i]);
+    }
+  }
+  rawEvPending = 0;
   std::fill_n(rawEnergy, 5000, 0);
   std::fill_n(rawChannel, 5000, -1);
   std::fill_n(rawTimeStamp, 5000, 0);
+  std::fill_n(rawFineTime, 5000, 0);
+  std::fill_n(rawReadTime, 5000, 0);
   rawEvCount = 0;
   rawEvLeftCount = 0;
 }
@@ -888,6 +1083,7 @@ void Digitizer::ClearData(){
       Energy[i][j] = 0;
       Channel[i][j] = -1;
       TimeStamp[i][j] = 0;
+      FineTime[i][j] = 0;
     }
   }
 
@@ -905,6 +1101,18 @@ string Digitizer::GetChannelMaskString(){
   return str;
 }
 
+RawHitFileHeader Digitizer::GetRawHitFileHeader(){
+  RawHitFileHeader header;
+  InitRawHitFileHeader(header);
+  header.nChannel = NChannel;
+  header.channelMask = ChannelMask;
+  header.ch2ns = ch2ns;
+  header.fineTimeBits = FineTimeBits;
+  header.serialNumber = serialNumber;
+  header.coincidentTimeWindow = CoincidentTimeWindow;
+  return header;
+}
+
 void Digitizer::SetDCOffset(int ch, float offset){
   DCOffset[ch] = offset;
 
@@ -1074,6 +1282,12 @@ int Digitizer::ProgramChannels(){
             /// Set Energy Fine gain, not working
             ret |= CAEN_DGTZ_WriteRegister(handle, 0x10C4 +  (i<<8), energyFineGain[i]);
 
+            /// DPP algorithm Control 2, bit[10:8] = 0b010, Extras2 = [31:16] extended time stamp, [15:10] flags, [9:0] fine time stamp
+            uint32_t control2 = 0;
+            ret |= CAEN_DGTZ_ReadRegister(handle, 0x10A0 + (i<<8), &control2);
+            control2 = (control2 & ~(0x7 << 8)) | (0x2 << 8);
+            ret |= CAEN_DGTZ_WriteRegister(handle, 0x10A0 +  (i<<8), control2);
+
             /// read the register to check the input is correct
             ///uint32_t * value = new uint32_t[8];
             ///ret = CAEN_DGTZ_ReadRegister(handle, 0x1028 + (i << 8), value);
@@ -1189,6 +1403,58 @@ void Digitizer::LoadGeneralSetting(string fileName){
 		if( count == 5  )   PrimBeamE = atof(line.substr(0, pos).c_str());// primary beam total energy [MeV]
 		if( count == 6  )   ScaleFactor = atof(line.substr(0, pos).c_str());// secondary beam scale factor [X.XX], e.g., 5% = 1.05
 		if( count == 7  )   PrimBeamCurrent = atof(line.substr(0, pos).c_str());// primary beam current on FCA001 [enA]
+		if( count == 17 )   {
+		  double w[NRateWindow] = {1., 10., 60.};
+		  sscanf(line.substr(0, pos).c_str(), "%lf %lf %lf", &w[0], &w[1], &w[2]);// rate windows [sec]
+		  rateMonitor->SetWindows(w[0], w[1], w[2]);
+		}
+		if( count == 18 )   {
+		  int persistent = 0;
+		  sscanf(line.substr(0, pos).c_str(), "%d %lf %lf", &persistent, &fileAutoSaveSec, &fileAutoSaveMB);// root file: persistent, AutoSave [sec], AutoSave [MB]
+		  isFilePersistent = (persistent == 1);
+		}
+		if( count == 19 )   {
+		  int compact = 0, delta = 0, wave = 1;
+		  sscanf(line.substr(0, pos).c_str(), "%d %d %d %d", &compact, &delta, &wave, &treeWaveLayout);// tree: compact, delta time stamp, wave branch, wave layout
+		  isTreeCompact = (compact == 1);
+		  isTreeDeltaTime = (delta == 1);
+		  isTreeWave = (wave == 1);
+		}
+		if( count == 20 )   {
+		  sscanf(line.substr(0, pos).c_str(), "%d %d %d %lf %d", &compAlgorithm, &compLevel, &basketSize, &autoFlushMB, &implicitMT);// compression, basket, auto-flush, implicit MT
+		}
+		if( count == 21 )   {
+		  int saveRaw = 0;
+		  int direct = 0;
+		  sscanf(line.substr(0, pos).c_str(), "%d %d %d %d %lf", &saveRaw, &rawBlockSizeMB, &direct, &rawBufferCount, &rawPreallocMB);// raw hit stream [1/0], block size [MB], O_DIRECT [1/0], buffers, preallocation [MB]
+		  isSaveRawHit = (saveRaw == 1);
+		  isRawDirectIO = (direct == 1);
+		}
+		if( count == 22 )   {
+		  int roll = 0;
+		  sscanf(line.substr(0, pos).c_str(), "%d %lf %lf", &roll, &rolloverMB, &rolloverSec);// rollover [1/0], max size [MB], max duration [sec]
+		  isFileRollover = (roll == 1);
+		}
+		if( count == 23 )   {
+		  int snap = 0;
+		  sscanf(line.substr(0, pos).c_str(), "%d %lf", &snap, &snapshotSec);// follow snapshot [1/0], every [sec]
+		  isFileSnapshot = (snap == 1);
+		}
+		if( count == 24 )   {
+		  sscanf(line.substr(0, pos).c_str(), "%d", &arrowOutput);// arrow IPC output, 0 off, 1 alongside the tree, 2 instead of the tree
+		}
+		if( count == 25 )   {
+		  int policy = 0;
+		  sscanf(line.substr(0, pos).c_str(), "%d %d %d %d %lf %lf %lf %d", &policy,
+		           &policyQueueMark[0], &policyQueueMark[1], &policyQueueMark[2],
+		           &policyDiskMark[0], &policyDiskMark[1], &policyDiskMark[2], &policyPrescale);// write policy [1/0], queue marks, disk marks [GB], prescale
+		  isWritePolicy = (policy == 1);
+		}
+		if( count == 26 )   {
+		  int histo = 0;
+		  sscanf(line.substr(0, pos).c_str(), "%d %lf", &histo, &checkpointSec);// histogram checkpoint [1/0], every [sec]
+		  isHistCheckpoint = (histo == 1);
+		}
 // RF-Sweeper On/Off [On/Off]
 // RF Sweeper (R501) Phase [deg]
 // RF Sweeper (R501) Amplitude [V]
@@ -1205,6 +1471,23 @@ void Digitizer::LoadGeneralSetting(string fileName){
     printf(" %-25s  %5d ch\n", "Coincident Time Window", CoincidentTimeWindow);
     printf(" %-25s  %5d ch\n", "Record Length", RecordLength);
     printf(" %-21s  infl%2d ch\n", "Experiment Number", ExpNumber);
+    printf(" %-25s  %.0f/%.0f/%.0f sec\n", "Rate Windows", rateMonitor->GetWindow(0), rateMonitor->GetWindow(1), rateMonitor->GetWindow(2));
+    if( isFilePersistent ) {
+      printf(" %-25s  every %.0f sec or %.0f MB\n", "Root file AutoSave", fileAutoSaveSec, fileAutoSaveMB);
+    }else{
+      printf(" %-25s  re-open every update\n", "Root file");
+    }
+    if( isFileRollover ) printf(" %-25s  every %.0f MB or %.0f sec\n", "Root file rollover", rolloverMB, rolloverSec);
+    if( isFileSnapshot ) printf(" %-25s  every %.0f sec\n", "Follow snapshot", snapshotSec);
+    if( arrowOutput > 0 ) printf(" %-25s  %s\n", "Arrow IPC output", arrowOutput == 1 ? "alongside the tree" : "instead of the tree");
+    if( isWritePolicy ) printf(" %-25s  queue %d/%d/%d batches, free disk %.0f/%.0f/%.0f GB, prescale %d\n", "Write policy",
+                                 policyQueueMark[0], policyQueueMark[1], policyQueueMark[2],
+                                 policyDiskMark[0], policyDiskMark[1], policyDiskMark[2], policyPrescale);
+    if( isHistCheckpoint ) printf(" %-25s  every %.0f sec\n", "Histogram checkpoint", checkpointSec);
+    printf(" %-25s  %s%s%s\n", "Tree schema", isTreeCompact ? "compact (nHit)" : "fixed (NChannel)",
+                                 isTreeCompact && isTreeDeltaTime ? ", delta time stamp" : "", isTreeWave ? (treeWaveLayout == 0 ? ", wave (TGraph)" : treeWaveLayout == 1 ? ", wave (int16)" : ", wave (int16 delta)") : "");
+    printf(" %-25s  alg %d, level %d, basket %d B, auto-flush %.0f MB, implicit MT %d\n", "Compression",
+                                 compAlgorithm, compLevel, basketSize, autoFlushMB, implicitMT);
     printf("====================================== \n");
 
   }
@@ -1219,6 +1502,7 @@ void Digitizer::ZeroSingleEvent(){
       singleEnergy[i] = 0;
       singleChannel[i] = -1;
       singleTimeStamp[i] = 0;
+      singleFineTime[i] = 0;
     }
   }
 }
@@ -1226,6 +1510,8 @@ void Digitizer::ZeroSingleEvent(){
 
 void Digitizer::StartACQ(){
 
+  rateMonitor->Clear(); /// time tag restarts from zero
+  liveTime->Start();
   CAEN_DGTZ_SWStartAcquisition(handle);
   printf("Acquisition Started for Board %d\n", boardID);
   AcqRun = true;
@@ -1240,6 +1526,7 @@ void Digitizer::ReadData(bool debug){
     return;
   }
   Nb = BufferSize;
+  ULong64_t readTime = LatencyMonitor::NowMicroSec();
   if (Nb == 0 || ret) {
      if( AcqMode == CAEN_DGTZ_DPP_ACQ_MODE_Mixed ){
         for(int i = 0 ; i < NChannel; i++ ){
@@ -1264,15 +1551,36 @@ void Digitizer::ReadData(bool debug){
     for (int ev = 0; ev < NumEvents[ch]; ev++) {
       TrgCnt[ch]++;
 
+      bool isListMode = (AcqMode != CAEN_DGTZ_DPP_ACQ_MODE_Mixed);
+      if( isListMode ) {
+        liveTime->AddTrigger(ch);
+        liveTime->AddLostFlags(ch, Events[ch][ev].Extras2);
+      }
+
+      ULong64_t timetag = (ULong64_t) Events[ch][ev].TimeTag;
+      ULong64_t rollOver = Events[ch][ev].Extras2 >> 16;
+      rollOver = rollOver << 31;
+      timetag  += rollOver ;
+      if( Events[ch][ev].TimeTag > 0 ) rateMonitor->Fill(ch, (double) timetag * ch2ns);
+
+      if( isListMode && rawHitWriter != NULL && Events[ch][ev].TimeTag > 0 ){ /// pile-up included, before any drop
+        unsigned short flags = (Events[ch][ev].Extras2 >> FineTimeBits) & 0x3F;
+        if( Events[ch][ev].Energy == 0 ) flags |= RawFlagPileUp;
+        ULong64_t timeHR = (timetag << FineTimeBits) + (Events[ch][ev].Extras2 & ((1 << FineTimeBits) - 1));
+        if( !rawHitWriter->Add(timeHR, Events[ch][ev].Energy, ch, flags) ) liveTime->AddRawDropped(ch);
+      }
+
       if( AcqMode == CAEN_DGTZ_DPP_ACQ_MODE_Mixed && ev > 0) break;
 
       if (Events[ch][ev].Energy > 0 && Events[ch][ev].TimeTag > 0 ) {
         ECnt[ch]++;
 
-        ULong64_t timetag = (ULong64_t) Events[ch][ev].TimeTag;
-        ULong64_t rollOver = Events[ch][ev].Extras2 >> 16;
-        rollOver = rollOver << 31;
-        timetag  += rollOver ;
+        if( rawEvCount + rawEvLeftCount >= MaxDataAShot ) { /// no room, drop the hit
+          if( isListMode ) liveTime->AddDropped(ch);
+          continue;
+        }
+
+        UShort_t fineTime = Events[ch][ev].Extras2 & ((1 << FineTimeBits) - 1); /// interpolated zero-crossing of the RC-CR2
 
         //printf("%d, %6d, %13lu | %5u | %13llu | %13llu \n", ch, Events[ch][ev].Energy,\
         // Events[ch][ev].TimeTag, Events[ch][ev].Extras2 , rollOver >> 32, timetag);
@@ -1280,15 +1588,19 @@ void Digitizer::ReadData(bool debug){
         rawChannel[rawEvCount + rawEvLeftCount] = ch;
         rawEnergy[rawEvCount + rawEvLeftCount]  = Events[ch][ev].Energy;
         rawTimeStamp[rawEvCount + rawEvLeftCount] = timetag;
+        rawFineTime[rawEvCount + rawEvLeftCount] = fineTime;
+        rawReadTime[rawEvCount + rawEvLeftCount] = readTime;
 
-        if( debug) printf("read: %3d, %2d| %2d, %5d, %10llu | %10llu | ret: %d \n", rawEvCount, rawEvLeftCount, ch, Events[ch][ev].Energy, timetag, rollOver, ret);
+        if( debug) printf("read: %3d, %2d| %2d, %5d, %10llu+%4d | %10llu | ret: %d \n", rawEvCount, rawEvLeftCount, ch, Events[ch][ev].Energy, timetag, fineTime, rollOver, ret);
 
         rawEvCount ++;
+        rawEvPending ++;
 
-        if( rawEvCount > MaxDataAShot ) printf(" More than %d data read from Digitizer in a shot! \n", MaxDataAShot);
+        if( rawEvCount + rawEvLeftCount == MaxDataAShot ) printf(" More than %d data read from Digitizer in a shot! further hits are dropped.\n", MaxDataAShot);
 
       } else { /// PileUp
           PurCnt[ch]++;
+          if( isListMode ) liveTime->AddPileUp(ch);
       }
 
       if( AcqMode == CAEN_DGTZ_DPP_ACQ_MODE_Mixed && ev == 0) {
@@ -1312,11 +1624,15 @@ void Digitizer::PrintReadStatistic(){
   uint64_t ElapsedTime = rawTimeRange * ch2ns * 1e-6; /// in mili-sec
   printf(" Readout Rate = %.5f MB/s\n", (float)Nb/((float)ElapsedTime*1048.576f));
 
-  printf("     | %7s| %12s| %8s\n", "Get", "TrgRate [Hz]", "PileUp");
+  TString rateHeader[NRateWindow];
+  for( int k = 0; k < NRateWindow; k++) rateHeader[k].Form("Trg %.0fs [Hz]", rateMonitor->GetWindow(k));
+  printf("     | %7s| %14s| %14s| %14s| %8s\n", "Get", rateHeader[0].Data(), rateHeader[1].Data(), rateHeader[2].Data(), "PileUp");
   for(int i = 0; i < NChannel; i++) {
     if (!(ChannelMask & (1<<i))) continue;
     if (TrgCnt[i]>0){
-      printf(" Ch %d| %7d| %12.2f| %7.2f%%\n", i, ECnt[i], (float)TrgCnt[i]/(float)ElapsedTime *1000., (float)PurCnt[i]*100/(float)TrgCnt[i]);
+      printf(" Ch %d| %7d| %14.2f| %14.2f| %14.2f| %7.2f%%\n", i, ECnt[i],
+                    rateMonitor->GetRate(i, 0), rateMonitor->GetRate(i, 1), rateMonitor->GetRate(i, 2),
+                    (float)PurCnt[i]*100/(float)TrgCnt[i]);
     }else{
       if (!(ChannelMask & (1<<i))){
         printf(" Ch %d|\tMasked\n", i);
@@ -1350,6 +1666,7 @@ void Digitizer::PrintEventBuildingStat(int updatePeriod){
   printf(" %5d| %5d| %5d| %5s\n", nChannelOpen, countNChannelEvent[nChannelOpen-1], totNChannelEvent[nChannelOpen-1], "left");
   printf("-----------------------------------\n");
   printf(" %5s| %5d| %5d| %5d\n", "total", countEventBuilt, totEventBuilt, rawEvLeftCount);
+  printf(" build scratch : %d hits, %.1f kB (grown %d times)\n", scratchSize, GetBuildScratchBytes()/1024., scratchGrowCount);
   printf("===============================================\n");
 
 }
@@ -1381,11 +1698,39 @@ void Digitizer::PrintThresholdAndDynamicRange(){
   }
 }
 
+void Digitizer::ReserveBuildScratch(int nHit){
+  if( nHit <= scratchSize ) return;
+
+  /// grow with 50% head room, round up to 1024 hits, so that re-allocation is rare
+  int newSize = nHit + nHit/2;
+  newSize = ((newSize + 1023)/1024)*1024;
+
+  delete [] scratchSortIndex;
+  delete [] scratchSortTime;
+  delete [] scratchChannel;
+  delete [] scratchEnergy;
+  delete [] scratchTimeStamp;
+  delete [] scratchFineTime;
+  delete [] scratchReadTime;
+
+  scratchSortIndex = new int [newSize];
+  scratchSortTime  = new ULong64_t [newSize];
+  scratchChannel   = new int [newSize];
+  scratchEnergy    = new UInt_t [newSize];
+  scratchTimeStamp = new ULong64_t [newSize];
+  scratchFineTime  = new UShort_t [newSize];
+  scratchReadTime  = new ULong64_t [newSize];
+
+  scratchSize = newSize;
+  scratchGrowCount ++;
+}
+
 void Digitizer::StopACQ(){
   if( !AcqRun ) return;
   int ret = CAEN_DGTZ_SWStopAcquisition(handle);
   ret |= CAEN_DGTZ_ClearData(handle);
   if( ret != 0 ) printf("something wrong when try to stop the ACQ\n");
+  liveTime->Stop();
   printf("\n\e[1m\e[33m====== Acquisition STOPPED for Board %d\e[0m\n", boardID);
   AcqRun = false;
 }
@@ -1402,28 +1747,37 @@ int Digitizer::BuildEvent(bool debug = false){
 
   countEventBuilt = 0;
 
-  int sortIndex[nRawData];
-  double bubbleSortTime[nRawData];
+  ReserveBuildScratch(nRawData);
+
+  int * sortIndex = scratchSortIndex;
+  ULong64_t * sortTime = scratchSortTime; /// the integer key, a double has 53 bits, not enough for the fine time stamp
   for( int i = 0; i < nRawData; i++){
-    bubbleSortTime[i] = double(rawTimeStamp[i]/1e12);
+    sortTime[i] = GetRawTimeStampHR(i);
+    sortIndex[i] = i;
     ///printf("%d, %d,  %llu \n", i,rawEnergy[i], rawTimeStamp[i]);
   }
 
-  TMath::BubbleLow(nRawData,bubbleSortTime,sortIndex);
+  std::stable_sort(sortIndex, sortIndex + nRawData, [sortTime](int a, int b){ return sortTime[a] < sortTime[b]; }); /// same time, in the order of reading
   ///=======Re-map
-  int channelT[nRawData];
-  ULong_t energyT[nRawData];
-  ULong64_t timeStampT[nRawData];
+  int * channelT = scratchChannel;
+  UInt_t * energyT = scratchEnergy;
+  ULong64_t * timeStampT = scratchTimeStamp;
+  UShort_t * fineTimeT = scratchFineTime;
+  ULong64_t * readTimeT = scratchReadTime;
   for( int i = 0; i < nRawData ; i++){
     channelT[i] = rawChannel[i];
     energyT[i] = rawEnergy[i];
     timeStampT[i] = rawTimeStamp[i];
+    fineTimeT[i] = rawFineTime[i];
+    readTimeT[i] = rawReadTime[i];
   }
   for( int i = 0; i < nRawData ; i++){
     rawChannel[i] = channelT[sortIndex[i]];
     rawTimeStamp[i] = timeStampT[sortIndex[i]];
+    rawFineTime[i] = fineTimeT[sortIndex[i]];
+    rawReadTime[i] = readTimeT[sortIndex[i]];
     rawEnergy[i] = energyT[sortIndex[i]];
-    if( debug) printf("Sorted: %3d| %2d, %5d, %10llu  \n", i, rawChannel[i], rawEnergy[i], rawTimeStamp[i]);
+    if( debug) printf("Sorted: %3d| %2d, %5d, %10llu+%4d  \n", i, rawChannel[i], rawEnergy[i], rawTimeStamp[i], rawFineTime[i]);
   }
 
   if( nRawData > 0 ) {
@@ -1438,12 +1792,13 @@ int Digitizer::BuildEvent(bool debug = false){
   if (debug) printf("=============Build event============\n");
   for( int k = 0; k < NChannel ; k++) countNChannelEvent[k] = 0;
   int endID = 0;
+  const ULong64_t windowHR = ((ULong64_t) CoincidentTimeWindow) << FineTimeBits; /// nano-sec x 2^FineTimeBits
   ///ClearData();
   for( int i = 0; i < nRawData-1; i++){
-    ULong64_t timeToEnd = (rawTimeStamp[nRawData-1] - rawTimeStamp[i]) * ch2ns ; // in nano-sec
+    ULong64_t timeToEnd = HRDiff(i, nRawData-1) * ch2ns ; // in nano-sec x 2^FineTimeBits
     endID = i;
     ///printf(" time to end %d / %d , %d, %d\n", timeToEnd, CoincidentTimeWindow, i , endID);
-    if( timeToEnd < CoincidentTimeWindow ) {
+    if( timeToEnd < windowHR ) {
       break;
     }
 
@@ -1485,11 +1840,11 @@ int Digitizer::BuildEvent(bool debug = false){
       unsigned int y = digitID ^ x; // bitwise XOR, 00=0, 01=1, 10=1, 11=0
       unsigned int z = 1 & (y >> rawChannel[j]); // if z = 0, the channel already token.
 
-      unsigned long long int timeDiff = (rawTimeStamp[j] - rawTimeStamp[i]) * ch2ns;
+      unsigned long long int timeDiff = HRDiff(i, j) * ch2ns; /// nano-sec x 2^FineTimeBits
 
       digitID += x;
 
-      if( timeDiff < CoincidentTimeWindow ){
+      if( timeDiff < windowHR ){
         /// if channel already taken
         ///if( z == 0 ) {
         ///  breakForSameChannel ++;
@@ -1503,7 +1858,7 @@ int Digitizer::BuildEvent(bool debug = false){
         break;
       }
 
-      if(debug) printf("       %3d | %d | %d, %llu, %llu, %d\n", digitID, rawChannel[j], z, rawTimeStamp[j], timeDiff, rawEnergy[j]);
+      if(debug) printf("       %3d | %d | %d, %llu, %.3f, %d\n", digitID, rawChannel[j], z, rawTimeStamp[j], timeDiff * 1.0 / (1 << FineTimeBits), rawEnergy[j]);
 
     }
 
@@ -1524,6 +1879,7 @@ int Digitizer::BuildEvent(bool debug = false){
     
     countNChannelEvent[numRawEventGrouped] += 1;
     totNChannelEvent[numRawEventGrouped] += 1;
+    if( numRawEventGrouped + 1 == nChannelForRealEvent ) rateMonitor->Fill(MaxNChannels, (double) rawTimeStamp[i] * ch2ns);
 
     if( debug){
       printf("============");
@@ -1533,17 +1889,22 @@ int Digitizer::BuildEvent(bool debug = false){
 
     ///fill in an event
     ZeroSingleEvent();
+    ULong64_t newestReadTime = 0;
     for( int j = i ; j <= i + numRawEventGrouped ; j++){
+      if( rawReadTime[j] > newestReadTime ) newestReadTime = rawReadTime[j];
       singleChannel[rawChannel[j]] = rawChannel[j];
       singleEnergy[rawChannel[j]] = rawEnergy[j];
       singleTimeStamp[rawChannel[j]] = rawTimeStamp[j];
+      singleFineTime[rawChannel[j]] = rawFineTime[j];
     }
 
     for(int pp = 0; pp < NChannel; pp++) {
       Channel[countEventBuilt][pp] = singleChannel[pp];
       Energy[countEventBuilt][pp] = singleEnergy[pp];
       TimeStamp[countEventBuilt][pp] = singleTimeStamp[pp];
+      FineTime[countEventBuilt][pp] = singleFineTime[pp];
     }
+    EventReadTime[countEventBuilt] = newestReadTime;
 
     countEventBuilt ++;
     totEventBuilt++;
@@ -1558,6 +1919,8 @@ int Digitizer::BuildEvent(bool debug = false){
     rawChannel[i] = rawChannel[i + endID];
     rawEnergy[i] = rawEnergy[i + endID];
     rawTimeStamp[i] = rawTimeStamp[i + endID];
+    rawFineTime[i] = rawFineTime[i + endID];
+    rawReadTime[i] = rawReadTime[i + endID];
   }
 
   ///for( int i = rawEvLeftCount ; i < MaxDataAShot ; i++){
@@ -1574,6 +1937,9 @@ int Digitizer::BuildEvent(bool debug = false){
 
   }
 
+  rawEvPending = rawEvLeftCount;
+  eventEmitTime = LatencyMonitor::NowMicroSec();
+
   return 1; /// for sucessful
 
 }
@@ -21,9 +21,52 @@
 #include "TRandom.h"
 #include "TLine.h"
 #include "TMacro.h"
+#include "TList.h"
+#include "TParameter.h"
+
+#include <ctime>
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "LatencyMonitor.h"
+#include "TimeIndex.h"
+#include "SettingJournal.h"
+#include "FileSnapshot.h"
+#include "ArrowWriter.h"
 
 using namespace std;
 
+///============ a batch of built events, handed from the event loop to the writer thread
+struct EventBatch{
+  int nEvent;
+  int nChannel;
+  vector<int>       channel;   /// nEvent x nChannel
+  vector<UInt_t>    energy;
+  vector<ULong64_t> timeStamp;
+  vector<UShort_t>  fineTime;
+  vector<ULong64_t> hitTime;   /// nEvent, read-out time of the newest hit, for LatencyMonitor
+
+  void Reset(int nCh){ nEvent = 0; nChannel = nCh; channel.clear(); energy.clear(); timeStamp.clear(); fineTime.clear(); hitTime.clear();}
+
+  void Add(int * ch, UInt_t * e, ULong64_t * t, UShort_t * tf, ULong64_t readTime){
+    channel.insert(channel.end(), ch, ch + nChannel);
+    energy.insert(energy.end(), e, e + nChannel);
+    timeStamp.insert(timeStamp.end(), t, t + nChannel);
+    if( tf != NULL ) {
+      fineTime.insert(fineTime.end(), tf, tf + nChannel);
+    }else{
+      fineTime.insert(fineTime.end(), nChannel, 0);
+    }
+    hitTime.push_back(readTime);
+    nEvent ++;
+  }
+};
+
 class FileIO {
   RQ_OBJECT("FileIO")
 public:
@@ -31,28 +74,108 @@ public:
   FileIO(TString filename);
   ~FileIO();
 
+  /// must be before SetTree. algorithm : 1 ZLIB, 2 LZMA, 4 LZ4, 5 ZSTD, 0 ROOT default,
+  /// basketSize in byte, autoFlushMB = the cluster size, 0 = same as AutoSave or ROOT default
+  void SetCompression(int algorithm, int level, int basketSize, double autoFlushMB);
+  TString GetCompressionName();
+
+  /// must be before SetTree, see TreeReader.h for the two schemas
+  void SetTreeSchema(bool compact, bool deltaTime, bool wave);
+  /// must be before SetTree, layout of the waveforms when the tree has them
+  ///   0 : "wave", TObjArray of TGraph
+  ///   1 : nWave, wCh[nWave], wLen[nWave] samples, wT[nWave] start time stamp [ch], nSample, wave16[nSample] int16 ADC
+  ///   2 : as 1, wave16 is delta-encoded within a trace, s[0], s[1]-s[0], s[2]-s[1], ...
+  /// pitchNs = sample pitch, preTrigger[nCh] = samples before the trigger per channel, for wT
+  void SetWaveLayout(int layout, double pitchNs, int ch2ns, int nCh, uint * preTrigger);
   void SetTree(TString treeName, int NumChannel);
   void Append();
   bool isOpen() {return openned;}
+  TString GetFileName() {return fileOutName;}  /// the current segment with rollover
+
+  /// rollover, the run is split into segments, base_000.root, base_001.root, ..., a new one is
+  /// started after maxMB or maxSec ( 0 = no limit ). Every segment has the tree, its UserInfo and
+  /// the setting macros, base_index.txt lists the file, events and time range of each segment.
+  void SetRollover(double maxMB, double maxSec);  /// right after the constructor
+  int  GetSegment() {return segment;}
+
+  /// time index, the "timeIndex" tree, entry range and cut counts per time bucket, see TimeIndex.h,
+  /// written with the tree at every AutoSave and Close()
+  void SetTimeIndex(double bucketSec, int ch2ns);
+  void SetIndexCuts(TObjArray * cutList, int chdE, int chE); /// the cuts counted from now on
+
+  /// settings journal, the "journal" tree, see SettingJournal.h. A change is tied to the number and the
+  /// time stamp of the events handed to the file so far, without opening the file, the journal is written
+  /// with the tree at every AutoSave and Close(), into every segment with rollover.
+  void Journal(TString key, int channel, double oldValue, double newValue, TString text = "");
+  void UpdateMacro(TString file, TString name = ""); /// a changed setting file, re-written at the next AutoSave or Close()
+  SettingJournal * GetJournal() {return &journal;}
+
+  /// persistent mode, the file stays open for the run, Save() does an AutoSave when
+  /// autoSaveSec has passed, ROOT does it by itself every autoSaveMB of filled data.
+  void SetPersistent(bool on, double autoSaveSec, double autoSaveMB);
+  bool IsPersistent() {return persistent;}
+  void Save(); /// end of an update, AutoSave when due in persistent mode, otherwise Close()
+
+  /// follow mode, a snapshot ( see FileSnapshot.h ) is published after each AutoSave, at least every
+  /// sec in persistent mode, and after each Close(), for a reader following the run. 0 = off.
+  void SetSnapshot(double sec);
+  void EndSnapshot(); /// the run is over, after the last Close()
 
-  void FillTree(int * Channel, UInt_t * Energy, ULong64_t* TimeStamp);
-  void WriteMacro(TString file);
-  void WriteHistogram(TH1F * hist) { hist->Write("", TObject::kOverwrite); }
-  void WriteHistogram(TH2F * hist) { hist->Write("", TObject::kOverwrite); }
-  void WriteHistogram(TMultiGraph * graph, TString name) { graph->Write(name, TObject::kOverwrite); }
-  void WriteHistogram(TGraph * graph, TString name) { graph->Write(name, TObject::kOverwrite); }
+  /// asynchronous writer, a thread fills the tree from batches of events,
+  /// the event loop only copies the built events into a batch. At most maxQueue batches wait,
+  /// a full queue drops the batch when droppedHit is given ( hits per channel added ), else waits.
+  /// In non-persistent mode the file is closed once the queue is empty, not after every batch.
+  void SetLatencyMonitor(LatencyMonitor * latency) {this->latency = latency;} /// writer stage
+  void StartWriter();
+  void StopWriter();                     /// drain the queue, then stop the thread
+  void Drain();                          /// wait until every pushed batch is in the tree
+  bool IsWriterRunning()                 {return writerRunning;}
+  EventBatch * GetFreeBatch();           /// from the recycle pool
+  bool PushBatch(EventBatch * batch, ULong64_t * droppedHit = NULL); /// false when dropped
+  void SetMaxQueue(int n)                {maxQueue = n > 1 ? n : 1;}
+  int  GetQueueDepth();
+  ULong64_t GetDroppedEvent()            {return droppedEvent;}
+  void PrintWriterStatistic();
 
-  void WriteObjArray(TObjArray * objArray){ fileOut->cd(); objArray->Write();}
+  /// the batches also go to an Arrow IPC stream, one record batch each, keepTree = false for the
+  /// Arrow stream only, the tree stays empty. NULL to detach, before closing the ArrowWriter.
+  void SetArrowWriter(ArrowWriter * arrow, bool keepTree);
 
-  void FillTreeWave(TGraph ** wave, double * waveEnergy, int nRaw,  int * chRaw, ULong64_t * timeStampRaw);
+  void FillTree(int * Channel, UInt_t * Energy, ULong64_t* TimeStamp, UShort_t * FineTime = NULL);
+  void WriteMacro(TString file, TString name = ""); /// also written into every new segment
+  void WriteHistogram(TH1F * hist) { lock_guard<recursive_mutex> lock(fileMutex); fileOut->cd(); hist->Write("", TObject::kOverwrite); }
+  void WriteHistogram(TH2F * hist) { lock_guard<recursive_mutex> lock(fileMutex); fileOut->cd(); hist->Write("", TObject::kOverwrite); }
+  void WriteHistogram(TMultiGraph * graph, TString name) { lock_guard<recursive_mutex> lock(fileMutex); fileOut->cd(); graph->Write(name, TObject::kOverwrite); }
+  void WriteHistogram(TGraph * graph, TString name) { lock_guard<recursive_mutex> lock(fileMutex); fileOut->cd(); graph->Write(name, TObject::kOverwrite); }
+  void WriteHistogram(TObject * obj) { lock_guard<recursive_mutex> lock(fileMutex); fileOut->cd(); obj->Write("", TObject::kOverwrite); } /// under its own name
+
+  void WriteObjArray(TObjArray * objArray){ lock_guard<recursive_mutex> lock(fileMutex); fileOut->cd(); objArray->Write();}
+  void AppendObjArray(TObjArray * objArray); /// Append(), write and save under one lock, the writer thread cannot Close() in between
+  void WriteTree(TTree * t) { lock_guard<recursive_mutex> lock(fileMutex); fileOut->cd(); t->Write("", TObject::kOverwrite); }
+
+  /// wave for layout 0, waveLength and waveSample for the int16 layouts, NULL = no traces for this event
+  void FillTreeWave(TGraph ** wave, int * waveLength, int16_t ** waveSample, double * waveEnergy, int nRaw,  int * chRaw, ULong64_t * timeStampRaw);
 
   void Close(){
+    lock_guard<recursive_mutex> lock(fileMutex);
+    if( !openned ) return;
+    WriteTimeIndex();
+    WriteJournal();
     if( tree != NULL ) tree->Write("", TObject::kOverwrite);
+    if( tree != NULL ) snapshotEntries = tree->GetEntries();
+    if( rollover ) UpdateSegmentInfo();
     fileOut->Close();
     openned = false;
+    PublishSnapshot(false);
+    if( rollover ) WriteIndex();
   }
 
-  double GetFileSize(){ return fileOut->GetSize() / 1024. / 1024.;}
+  double GetFileSize(){
+    if( writerRunning ) return fileSizeMB; /// do not wait for the writer
+    lock_guard<recursive_mutex> lock(fileMutex);
+    fileSizeMB = fileOut->GetSize() / 1024. / 1024.;
+    return fileSizeMB;
+  }
 
 private:
   TString fileOutName;
@@ -64,12 +187,131 @@ private:
 
   int NumChannel;
   ULong64_t * timeStamp;
+  UShort_t * fineTime;  /// 1 ch = 2^10 fine-ch
   UInt_t * energy;
   int * channel;
   TGraph ** waveForm;
 
+  ///===== tree schema
+  bool isCompact;     /// nHit + ch/e/t/tf[nHit], the arrays above are filled up to nHit
+  bool isDeltaTime;   /// compact only, t[k>0] - t[0]
+  bool hasWave;       /// the "wave" branch
+  int nHit;
+  UChar_t * hitCh;
+
+  void BuildTree();   /// the tree and its branches in the current file
+  void SortHits();    /// compact, sort the hits in time
+  void DeltaEncode(); /// compact, t[k>0] - t[0], unsigned, so it is exact even if t[k] < t[0]
+
   TObjArray * waveList;
 
+  ///===== int16 waveforms
+  int waveLayout;
+  double wavePitchNs;
+  vector<ULong64_t> wavePreTrigger;  /// per channel, in ch
+  int nWave;
+  UChar_t * wCh;
+  Int_t * wLen;
+  ULong64_t * wT;
+  int nSample;
+  Short_t * wSample;
+  int wSampleSize;             /// allocated
+
+  void SetWaveAddress();
+  void AddWave(int ch, ULong64_t t, int length, int16_t * sample);
+
+  bool persistent;
+  double autoSaveSec;
+  double autoSaveMB;
+  time_t lastSaveTime;
+
+  void ApplyAutoSave();
+  void AutoSaveIfDue();
+
+  ///===== rollover
+  struct SegmentInfo{
+    TString fileName;
+    ULong64_t nEvent;
+    ULong64_t firstTime;  /// ch, earliest hit of the first event
+    ULong64_t lastTime;
+    time_t openTime;
+    time_t closeTime;
+    double sizeMB;
+  };
+  bool rollover;
+  double rolloverMB;
+  double rolloverSec;
+  TString baseName;
+  int segment;
+  vector<SegmentInfo> segmentList;
+  vector<pair<TString, TString> > macroList;  /// file, name
+
+  void OpenSegment();
+  void RolloverIfDue();
+  void CountEvent(ULong64_t * TimeStamp, int n);
+  void UpdateSegmentInfo();
+  void WriteIndex();
+
+  ///===== time index
+  TimeIndex * timeIndex;
+  void IndexEvent(UInt_t * Energy, ULong64_t * TimeStamp); /// channel indexed, after tree->Fill()
+  void WriteTimeIndex();
+
+  ///===== settings journal, journal and the counters under queueMutex
+  SettingJournal journal;
+  ULong64_t handedEvent;      /// pushed or filled, run-wide
+  ULong64_t handedTime;       /// latest hit of the last event [ch]
+  bool isMacroChanged;
+  void HandEvent(int nEvent, ULong64_t lastTime);
+  void WriteJournal();
+  TString MacroName(TString file, TString name);
+  void AddMacro(TString file, TString writeName);
+
+  ///===== follow mode
+  double snapshotSec;
+  time_t lastSnapshotTime;
+  Long64_t snapshotEntries;   /// of the tree at the last AutoSave or Close
+  void PublishSnapshot(bool isEnd);
+
+  ///====== writer thread
+  recursive_mutex fileMutex;      /// every access to fileOut and tree
+  mutex queueMutex;               /// queue, pool and the counters below
+  condition_variable queueCond;   /// a batch is pushed, or stop
+  condition_variable drainCond;   /// a batch is done
+  deque<EventBatch *> queue;
+  vector<EventBatch *> pool;
+  thread writer;
+  bool writerRunning;
+  bool writerStop;
+  bool writerBusy;
+  int maxQueueDepth;
+  int maxQueue;                   /// batches waiting, at most
+  ULong64_t writtenEvent;
+  ULong64_t droppedEvent;         /// in batches dropped at a full queue
+  ULong64_t lastPrintEvent;
+  double lastPrintSize;
+  double writerBusySec;
+  double lastPrintBusySec;
+  time_t lastPrintTime;
+  LatencyMonitor * latency;
+  ArrowWriter * arrowWriter;
+  bool isTreeOutput;              /// fill the tree from the batches
+  atomic<double> fileSizeMB;      /// updated by the writer after each batch
+  atomic<double> treeTotMB;       /// uncompressed
+  atomic<double> treeZipMB;       /// compressed
+  double lastPrintTotMB;
+
+  ///===== compression and basket
+  int compAlgorithm;
+  int compLevel;
+  int basketSize;
+  double autoFlushMB;
+
+  void UpdateTreeSize();
+
+  void WriterLoop();
+  void WriteBatch(EventBatch * batch); /// under fileMutex
+
 };
 
 FileIO::FileIO(TString filename){
@@ -83,44 +325,419 @@ FileIO::FileIO(TString filename){
 
   NumChannel = 0;
   timeStamp = NULL;
+  fineTime = NULL;
   energy = NULL;
   channel = NULL;
   waveForm = NULL;
 
+  isCompact = false;
+  isDeltaTime = false;
+  hasWave = true;
+  nHit = 0;
+  hitCh = NULL;
+
   waveList = NULL;
 
+  waveLayout = 0;
+  wavePitchNs = 2;
+  nWave = 0;
+  wCh = NULL;
+  wLen = NULL;
+  wT = NULL;
+  nSample = 0;
+  wSample = NULL;
+  wSampleSize = 0;
+
+  persistent = false;
+  autoSaveSec = 30;
+  autoSaveMB = 100;
+  lastSaveTime = time(NULL);
+
+  writerRunning = false;
+  writerStop = false;
+  writerBusy = false;
+  maxQueueDepth = 0;
+  maxQueue = 64;
+  writtenEvent = 0;
+  droppedEvent = 0;
+  handedEvent = 0;
+  handedTime = 0;
+  isMacroChanged = false;
+  lastPrintEvent = 0;
+  lastPrintSize = 0;
+  writerBusySec = 0;
+  lastPrintBusySec = 0;
+  lastPrintTime = time(NULL);
+  latency = NULL;
+  arrowWriter = NULL;
+  isTreeOutput = true;
+  fileSizeMB = 0;
+  treeTotMB = 0;
+  treeZipMB = 0;
+  lastPrintTotMB = 0;
+
+  compAlgorithm = 0;
+  compLevel = -1;
+  basketSize = 0;
+  autoFlushMB = 0;
+
+  rollover = false;
+  rolloverMB = 0;
+  rolloverSec = 0;
+  segment = 0;
+
+  timeIndex = NULL;
+
+  snapshotSec = 0;
+  lastSnapshotTime = time(NULL);
+  snapshotEntries = 0;
+
 }
 
 FileIO::~FileIO(){
 
+  StopWriter();
+  for( int i = 0; i < (int) pool.size(); i++) delete pool[i];
+
   delete fileOut;
+  delete timeIndex;
 
   delete timeStamp;
+  delete fineTime;
   delete energy;
   delete channel;
+  delete [] hitCh;
 
   delete waveList;
+
+  delete [] wCh;
+  delete [] wLen;
+  delete [] wT;
+  delete [] wSample;
 }
 
-void FileIO::WriteMacro(TString file){
-  //printf("writing file %s \n", file.Data());
-  TMacro macro(file);
+TString FileIO::MacroName(TString file, TString name){
+  if( name != "" ) return name;
   TString writeName = file;
   int finddot = file.Last('.');
   writeName.Remove(finddot);
+  return writeName;
+}
+
+void FileIO::WriteMacro(TString file, TString name){
+  lock_guard<recursive_mutex> lock(fileMutex);
+  fileOut->cd();
+  //printf("writing file %s \n", file.Data());
+  TMacro macro(file);
+  TString writeName = MacroName(file, name);
   macro.Write(writeName,  TObject::kOverwrite);
+  AddMacro(file, writeName);
+}
+
+void FileIO::AddMacro(TString file, TString writeName){
+  lock_guard<mutex> lock(queueMutex); /// UpdateMacro() does not take the file
+  for( int i = 0; i < (int) macroList.size(); i++){
+    if( macroList[i].second == writeName ) { macroList[i].first = file; return;}
+  }
+  macroList.push_back(make_pair(file, writeName));
+}
+
+void FileIO::SetPersistent(bool on, double autoSaveSec, double autoSaveMB){
+  persistent = on;
+  this->autoSaveSec = autoSaveSec;
+  this->autoSaveMB = autoSaveMB;
+  ApplyAutoSave();
+}
+
+void FileIO::ApplyAutoSave(){
+  if( tree == NULL ) return;
+  if( persistent && autoSaveMB > 0 ){
+    Long64_t bytes = (Long64_t) (autoSaveMB * 1024 * 1024);
+    tree->SetAutoFlush(-bytes); /// bound the data kept in memory
+    tree->SetAutoSave(-bytes);  /// and on disk, but not in the tree header
+  }
+  if( autoFlushMB > 0 ) tree->SetAutoFlush(-(Long64_t) (autoFlushMB * 1024 * 1024)); /// cluster size, unit of parallel compression
+}
+
+void FileIO::SetCompression(int algorithm, int level, int basketSize, double autoFlushMB){
+  lock_guard<recursive_mutex> lock(fileMutex);
+  compAlgorithm = algorithm;
+  compLevel = level;
+  this->basketSize = basketSize;
+  this->autoFlushMB = autoFlushMB;
+  if( compAlgorithm > 0 && compLevel >= 0 ) fileOut->SetCompressionSettings(compAlgorithm * 100 + compLevel);
+}
+
+TString FileIO::GetCompressionName(){
+  const char * alg = NULL;
+  switch( compAlgorithm ){
+    case 1 : alg = "ZLIB"; break;
+    case 2 : alg = "LZMA"; break;
+    case 4 : alg = "LZ4"; break;
+    case 5 : alg = "ZSTD"; break;
+    default: return "ROOT default";
+  }
+  TString name;
+  name.Form("%s-%d", alg, compLevel);
+  return name;
+}
+
+void FileIO::UpdateTreeSize(){
+  if( tree == NULL || !openned ) return;
+  fileSizeMB = fileOut->GetSize() / 1024. / 1024.;
+  treeTotMB  = tree->GetTotBytes() / 1024. / 1024.;
+  treeZipMB  = tree->GetZipBytes() / 1024. / 1024.;
+}
+
+void FileIO::Save(){
+  if( writerRunning ) return; /// the writer thread saves after each batch
+  AutoSaveIfDue();
+}
+
+void FileIO::AutoSaveIfDue(){
+  lock_guard<recursive_mutex> lock(fileMutex);
+  if( !openned ) return;
+  RolloverIfDue();
+  if( !persistent ) {
+    Close();
+    return;
+  }
+  time_t now = time(NULL);
+  bool snapshotDue = snapshotSec > 0 && difftime(now, lastSnapshotTime) >= snapshotSec;
+  if( difftime(now, lastSaveTime) >= autoSaveSec || snapshotDue ){
+    WriteTimeIndex(); /// before, so that the saved key list has it
+    WriteJournal();
+    if( tree != NULL ) tree->AutoSave("SaveSelf");
+    lastSaveTime = now;
+    if( tree != NULL ) snapshotEntries = tree->GetEntries();
+    PublishSnapshot(false);
+  }
+}
+
+//############################################ follow mode
+void FileIO::SetSnapshot(double sec){
+  lock_guard<recursive_mutex> lock(fileMutex);
+  snapshotSec = sec;
+}
+
+void FileIO::EndSnapshot(){
+  lock_guard<recursive_mutex> lock(fileMutex);
+  PublishSnapshot(true);
+}
+
+void FileIO::PublishSnapshot(bool isEnd){
+  if( snapshotSec <= 0 ) return;
+  TString snapshotName = rollover ? baseName : fileOutName;
+  if( snapshotName.EndsWith(".root") ) snapshotName.Remove(snapshotName.Length() - 5);
+  snapshotName += ".snapshot";
+
+  FileSnapshot snapshot;
+  snapshot.fileName = fileOutName;
+  snapshot.entries = snapshotEntries;
+  snapshot.time = time(NULL);
+  snapshot.isEnd = isEnd;
+  snapshot.Write(snapshotName);
+  lastSnapshotTime = snapshot.time;
+}
+
+//############################################ rollover
+void FileIO::SetRollover(double maxMB, double maxSec){
+  lock_guard<recursive_mutex> lock(fileMutex);
+  if( maxMB <= 0 && maxSec <= 0 ) return;
+  rolloverMB = maxMB;
+  rolloverSec = maxSec;
+  if( rollover ) return;
+  rollover = true;
+
+  /// the file of the constructor is still empty, the run starts at segment 0
+  baseName = fileOutName;
+  if( baseName.EndsWith(".root") ) baseName.Remove(baseName.Length() - 5);
+  if( openned ) fileOut->Close();
+  delete fileOut;
+  fileOut = NULL;
+  openned = false;
+  gSystem->Unlink(fileOutName);
+
+  segment = 0;
+  OpenSegment();
+}
+
+void FileIO::OpenSegment(){
+  fileOutName.Form("%s_%03d.root", baseName.Data(), segment);
+  delete fileOut;
+  fileOut = new TFile(fileOutName, "RECREATE");
+  openned = true;
+  if( compAlgorithm > 0 && compLevel >= 0 ) fileOut->SetCompressionSettings(compAlgorithm * 100 + compLevel);
+
+  fileOut->cd();
+  vector<pair<TString, TString> > macros;
+  {
+    lock_guard<mutex> lock(queueMutex); /// copy only, HandEvent() and Journal() wait on this lock
+    macros = macroList;
+    isMacroChanged = false;
+  }
+  for( int i = 0; i < (int) macros.size(); i++){
+    TMacro macro(macros[i].first);
+    macro.Write(macros[i].second, TObject::kOverwrite);
+  }
+
+  SegmentInfo info;
+  info.fileName = fileOutName;
+  info.nEvent = 0;
+  info.firstTime = 0;
+  info.lastTime = 0;
+  info.openTime = time(NULL);
+  info.closeTime = 0;
+  info.sizeMB = 0;
+  segmentList.push_back(info);
+  if( timeIndex != NULL ) timeIndex->Clear(); /// the entries start again at 0
+  snapshotEntries = 0;
+
+  if( tree != NULL ) BuildTree(); /// not for the first segment, SetTree() does it
+  lastSaveTime = time(NULL);
+  printf("====== new segment : %s\n", fileOutName.Data());
+}
+
+void FileIO::RolloverIfDue(){
+  if( !rollover || segmentList.empty() ) return;
+  SegmentInfo &info = segmentList.back();
+  if( info.nEvent == 0 ) return;
+
+  bool due = false;
+  if( rolloverMB > 0 && fileOut->GetSize() / 1024. / 1024. >= rolloverMB ) due = true;
+  if( rolloverSec > 0 && difftime(time(NULL), info.openTime) >= rolloverSec ) due = true;
+  if( !due ) return;
+
+  Close();
+  segment ++;
+  OpenSegment();
+  UpdateTreeSize();
+}
+
+void FileIO::CountEvent(ULong64_t * TimeStamp, int n){
+  if( !rollover || segmentList.empty() ) return;
+  ULong64_t t = 0;
+  for( int i = 0; i < n; i++){
+    if( TimeStamp[i] > 0 && (t == 0 || TimeStamp[i] < t) ) t = TimeStamp[i];
+  }
+  SegmentInfo &info = segmentList.back();
+  info.nEvent ++;
+  if( t == 0 ) return;
+  if( info.firstTime == 0 || t < info.firstTime ) info.firstTime = t;
+  if( t > info.lastTime ) info.lastTime = t;
+}
+
+void FileIO::UpdateSegmentInfo(){
+  if( segmentList.empty() ) return;
+  SegmentInfo &info = segmentList.back();
+  info.closeTime = time(NULL);
+  info.sizeMB = fileOut->GetSize() / 1024. / 1024.;
+}
+
+void FileIO::WriteIndex(){
+  TString indexName = baseName + "_index.txt";
+  FILE * index = fopen(indexName.Data(), "w");
+  if( index == NULL ) return;
+  fprintf(index, "# segment, file, events, first time stamp [ch], last time stamp [ch], open, close [unix time], size [MB]\n");
+  for( int i = 0; i < (int) segmentList.size(); i++){
+    SegmentInfo &info = segmentList[i];
+    fprintf(index, "%4d  %s  %12llu  %16llu  %16llu  %ld  %ld  %10.3f\n", i, info.fileName.Data(), info.nEvent,
+                   info.firstTime, info.lastTime, (long) info.openTime, (long) info.closeTime, info.sizeMB);
+  }
+  fclose(index);
+}
+
+//############################################ time index
+void FileIO::SetTimeIndex(double bucketSec, int ch2ns){
+  lock_guard<recursive_mutex> lock(fileMutex);
+  if( timeIndex == NULL ) timeIndex = new TimeIndex();
+  timeIndex->SetBucket(bucketSec, ch2ns);
+}
+
+void FileIO::SetIndexCuts(TObjArray * cutList, int chdE, int chE){
+  lock_guard<recursive_mutex> lock(fileMutex);
+  if( timeIndex != NULL ) timeIndex->SetCuts(cutList, chdE, chE);
+}
+
+void FileIO::IndexEvent(UInt_t * Energy, ULong64_t * TimeStamp){
+  if( timeIndex == NULL ) return;
+  timeIndex->Add(tree->GetEntries() - 1, Energy, TimeStamp, NumChannel);
+}
+
+void FileIO::WriteTimeIndex(){
+  if( timeIndex == NULL || !openned ) return;
+  fileOut->cd();
+  TTree * indexTree = timeIndex->MakeTree();
+  indexTree->Write("timeIndex", TObject::kOverwrite);
+  delete indexTree;
+}
+
+//############################################ settings journal
+void FileIO::Journal(TString key, int channel, double oldValue, double newValue, TString text){
+  lock_guard<mutex> lock(queueMutex); /// the pushed batches are counted, not only the written ones
+  journal.Add(key, channel, oldValue, newValue, handedEvent, handedTime, text);
+}
+
+void FileIO::UpdateMacro(TString file, TString name){
+  AddMacro(file, MacroName(file, name));
+  lock_guard<mutex> lock(queueMutex);
+  isMacroChanged = true;
+}
+
+void FileIO::HandEvent(int nEvent, ULong64_t lastTime){
+  lock_guard<mutex> lock(queueMutex);
+  handedEvent += nEvent;
+  if( nEvent > 0 ) handedTime = lastTime;
+}
+
+void FileIO::WriteJournal(){
+  if( !openned ) return;
+  vector<pair<TString, TString> > macros;
+  SettingJournal rows;
+  {
+    lock_guard<mutex> lock(queueMutex); /// copy under the lock, write without it
+    if( isMacroChanged ) macros = macroList;
+    isMacroChanged = false;
+    rows = journal;
+  }
+  fileOut->cd();
+  for( int i = 0; i < (int) macros.size(); i++){
+    TMacro macro(macros[i].first);
+    macro.Write(macros[i].second, TObject::kOverwrite);
+  }
+  if( rows.GetN() == 0 ) return;
+  TTree * journalTree = rows.MakeTree();
+  journalTree->Write("journal", TObject::kOverwrite);
+  delete journalTree;
+}
+
+void FileIO::SetTreeSchema(bool compact, bool deltaTime, bool wave){
+  isCompact = compact;
+  isDeltaTime = compact && deltaTime;
+  hasWave = wave;
+}
+
+void FileIO::SetWaveLayout(int layout, double pitchNs, int ch2ns, int nCh, uint * preTrigger){
+  waveLayout = (layout >= 0 && layout <= 2) ? layout : 0;
+  wavePitchNs = pitchNs;
+  wavePreTrigger.assign(nCh, 0);
+  for( int i = 0; i < nCh && preTrigger != NULL; i++){
+    wavePreTrigger[i] = (ULong64_t) (preTrigger[i] * pitchNs / ch2ns);
+  }
 }
 
 void FileIO::SetTree(TString treeName, int NumChannel){
 
-  this->treeName = treeName;
-  tree = new TTree(treeName, treeName);
+  lock_guard<recursive_mutex> lock(fileMutex);
 
+  this->treeName = treeName;
   this->NumChannel = NumChannel;
 
   timeStamp = new ULong64_t[NumChannel];
+  fineTime  = new UShort_t[NumChannel];
   energy    = new UInt_t[NumChannel];
   channel   = new int[NumChannel];
+  hitCh     = new UChar_t[NumChannel];
 
   waveList = new TObjArray();
   waveForm = new TGraph*[NumChannel];
@@ -129,60 +746,404 @@ void FileIO::SetTree(TString treeName, int NumChannel){
     waveList->Add(waveForm[i]);
   }
 
-  TString expre;
-  expre.Form("channel[%d]/I", NumChannel); tree->Branch("ch", channel, expre);
-  expre.Form("energy[%d]/i", NumChannel); tree->Branch("e", energy, expre);
-  expre.Form("timeStamp[%d]/l", NumChannel); tree->Branch("t", timeStamp, expre);
+  if( hasWave && waveLayout > 0 ){
+    wCh  = new UChar_t[NumChannel];
+    wLen = new Int_t[NumChannel];
+    wT   = new ULong64_t[NumChannel];
+    wSampleSize = 4096 * NumChannel;
+    wSample = new Short_t[wSampleSize];
+  }
+
+  BuildTree();
+}
+
+void FileIO::BuildTree(){
 
-  tree->Branch("wave", "TObjArray", &waveList);
+  fileOut->cd();
+  tree = new TTree(treeName, treeName);
+
+  if( isCompact ){
+    tree->Branch("nHit", &nHit, "nHit/I");
+    tree->Branch("ch", hitCh, "ch[nHit]/b");
+    tree->Branch("e", energy, "e[nHit]/i");
+    tree->Branch("t", timeStamp, "t[nHit]/l");
+    tree->Branch("tf", fineTime, "tf[nHit]/s");
+  }else{
+    TString expre;
+    expre.Form("channel[%d]/I", NumChannel); tree->Branch("ch", channel, expre);
+    expre.Form("energy[%d]/i", NumChannel); tree->Branch("e", energy, expre);
+    expre.Form("timeStamp[%d]/l", NumChannel); tree->Branch("t", timeStamp, expre);
+    expre.Form("fineTime[%d]/s", NumChannel); tree->Branch("tf", fineTime, expre);
+  }
+
+  if( hasWave && waveLayout == 0 ) tree->Branch("wave", "TObjArray", &waveList);
+  if( hasWave && waveLayout > 0 ){
+    tree->Branch("nWave", &nWave, "nWave/I");
+    tree->Branch("wCh", wCh, "wCh[nWave]/b");
+    tree->Branch("wLen", wLen, "wLen[nWave]/I");
+    tree->Branch("wT", wT, "wT[nWave]/l");
+    tree->Branch("nSample", &nSample, "nSample/I");
+    tree->Branch("wave16", wSample, "wave16[nSample]/S");
+  }
+
+  tree->GetUserInfo()->Add(new TParameter<int>("compact", isCompact ? 1 : 0));
+  tree->GetUserInfo()->Add(new TParameter<int>("deltaT", isDeltaTime ? 1 : 0));
+  tree->GetUserInfo()->Add(new TParameter<int>("wave", hasWave ? 1 : 0));
+  tree->GetUserInfo()->Add(new TParameter<int>("nChannel", NumChannel));
+  Long64_t firstEvent = 0; /// run-wide number of the first entry, as the event of the journal
+  for( int i = 0; i + 1 < (int) segmentList.size(); i++) firstEvent += segmentList[i].nEvent;
+  tree->GetUserInfo()->Add(new TParameter<Long64_t>("firstEvent", firstEvent));
+  if( hasWave ){
+    tree->GetUserInfo()->Add(new TParameter<int>("waveLayout", waveLayout));
+    tree->GetUserInfo()->Add(new TParameter<double>("wavePitch", wavePitchNs));
+  }
+
+  if( basketSize > 0 ) tree->SetBasketSize("*", basketSize);
 
   tree->Write(treeName, TObject::kOverwrite);
+  ApplyAutoSave();
 
 }
 
 void FileIO::Append(){
 
+  lock_guard<recursive_mutex> lock(fileMutex);
+  if( openned ) { /// persistent mode, nothing to re-open
+    fileOut->cd();
+    return;
+  }
+
+  delete fileOut;
   fileOut = new TFile(fileOutName, "UPDATE");
   openned = true;
   tree = (TTree*) fileOut->Get(treeName);
 
+  if( isCompact ){
+    tree->SetBranchAddress("nHit", &nHit);
+    tree->SetBranchAddress("ch", hitCh);
+  }else{
+    tree->SetBranchAddress("ch", channel);
+  }
   tree->SetBranchAddress("e", energy);
   tree->SetBranchAddress("t", timeStamp);
-  tree->SetBranchAddress("ch", channel);
-  tree->SetBranchAddress("wave", &waveList);
+  tree->SetBranchAddress("tf", fineTime);
+  if( hasWave && waveLayout == 0 ) tree->SetBranchAddress("wave", &waveList);
+  if( hasWave && waveLayout > 0 ) SetWaveAddress();
+  ApplyAutoSave();
+
+}
 
+void FileIO::AppendObjArray(TObjArray * objArray){
+  lock_guard<recursive_mutex> lock(fileMutex);
+  Append();
+  fileOut->cd();
+  objArray->Write();
+  AutoSaveIfDue(); /// as Save(), also with the writer running
 }
 
-void FileIO::FillTree(int * Channel, UInt_t * Energy, ULong64_t * TimeStamp){
+void FileIO::FillTree(int * Channel, UInt_t * Energy, ULong64_t * TimeStamp, UShort_t * FineTime){
+
+  lock_guard<recursive_mutex> lock(fileMutex);
+
+  CountEvent(TimeStamp, NumChannel);
+
+  if( isCompact ){
+    nHit = 0;
+    for(int ch = 0; ch < NumChannel; ch++){
+      if( Channel[ch] < 0 ) continue; /// no hit
+      hitCh[nHit] = ch;
+      energy[nHit] = Energy[ch];
+      timeStamp[nHit] = TimeStamp[ch];
+      fineTime[nHit] = FineTime == NULL ? 0 : FineTime[ch];
+      nHit ++;
+    }
+    SortHits();
+    DeltaEncode();
+    tree->Fill();
+    IndexEvent(Energy, TimeStamp);
+    return;
+  }
 
   for(int ch = 0; ch < NumChannel; ch++){
     energy[ch] = Energy[ch];
     timeStamp[ch] = TimeStamp[ch];
+    fineTime[ch] = FineTime == NULL ? 0 : FineTime[ch];
     channel[ch] = Channel[ch];
   }
 
   tree->Fill();
+  IndexEvent(Energy, TimeStamp);
+}
+
+void FileIO::SortHits(){
+  ///insertion sort, nHit is small
+  for( int i = 1; i < nHit; i++){
+    UChar_t c = hitCh[i]; UInt_t e = energy[i]; ULong64_t t = timeStamp[i]; UShort_t tf = fineTime[i];
+    int j = i - 1;
+    while( j >= 0 && ( timeStamp[j] > t || (timeStamp[j] == t && fineTime[j] > tf) ) ){
+      hitCh[j+1] = hitCh[j]; energy[j+1] = energy[j]; timeStamp[j+1] = timeStamp[j]; fineTime[j+1] = fineTime[j];
+      j--;
+    }
+    hitCh[j+1] = c; energy[j+1] = e; timeStamp[j+1] = t; fineTime[j+1] = tf;
+  }
+}
+
+void FileIO::DeltaEncode(){
+  if( !isDeltaTime ) return;
+  for( int k = nHit - 1; k > 0; k--) timeStamp[k] -= timeStamp[0];
+}
+
+void FileIO::SetWaveAddress(){
+  tree->SetBranchAddress("nWave", &nWave);
+  tree->SetBranchAddress("wCh", wCh);
+  tree->SetBranchAddress("wLen", wLen);
+  tree->SetBranchAddress("wT", wT);
+  tree->SetBranchAddress("nSample", &nSample);
+  tree->SetBranchAddress("wave16", wSample);
 }
 
-void FileIO::FillTreeWave(TGraph ** wave, double * waveEnergy, int nRaw, int * chRaw, ULong64_t * timeStampRaw){
+void FileIO::AddWave(int ch, ULong64_t t, int length, int16_t * sample){
+  if( sample == NULL || length <= 0 ) return;
 
+  if( nSample + length > wSampleSize ){ /// longer traces than expected, grow and re-point the branch
+    int size = 2 * (nSample + length);
+    Short_t * temp = new Short_t[size];
+    for( int i = 0; i < nSample; i++) temp[i] = wSample[i];
+    delete [] wSample;
+    wSample = temp;
+    wSampleSize = size;
+    tree->SetBranchAddress("wave16", wSample);
+  }
+
+  wCh[nWave] = ch;
+  wLen[nWave] = length;
+  ULong64_t pre = ch < (int) wavePreTrigger.size() ? wavePreTrigger[ch] : 0;
+  wT[nWave] = t > pre ? t - pre : 0;
+
+  Short_t * out = wSample + nSample;
+  if( waveLayout == 2 ){
+    Short_t last = 0;
+    for( int i = 0; i < length; i++){
+      out[i] = sample[i] - last;
+      last = sample[i];
+    }
+  }else{
+    for( int i = 0; i < length; i++) out[i] = sample[i];
+  }
+
+  nSample += length;
+  nWave ++;
+}
+
+void FileIO::FillTreeWave(TGraph ** wave, int * waveLength, int16_t ** waveSample, double * waveEnergy, int nRaw, int * chRaw, ULong64_t * timeStampRaw){
+
+  lock_guard<recursive_mutex> lock(fileMutex);
   waveList->Clear();
+  vector<UInt_t> indexE(NumChannel, 0);
+  vector<ULong64_t> indexT(NumChannel, 0);
+  nHit = 0;
+  nWave = 0;
+  nSample = 0;
   for( int ch = 0; ch < NumChannel; ch++){
-    channel[ch] = ch;
-    energy[ch] = waveEnergy[ch];
-    waveList->Add(wave[ch]);
-    timeStamp[ch] = 0;
+    ULong64_t t = 0;
     for( int ev = 0; ev < nRaw; ev ++){
       if( ch == chRaw[ev]){
-        timeStamp[ch] = timeStampRaw[ev];
+        t = timeStampRaw[ev];
       }
     }
+    indexE[ch] = waveEnergy[ch];
+    indexT[ch] = t;
+    if( isCompact && t == 0 && waveEnergy[ch] == 0 ) continue;
+
+    int k = isCompact ? nHit : ch;
+    channel[k] = ch;
+    hitCh[k] = ch;
+    energy[k] = waveEnergy[ch];
+    timeStamp[k] = t;
+    fineTime[k] = 0;
+    if( hasWave && waveLayout == 0 && wave != NULL ) waveList->Add(wave[ch]);
+    if( hasWave && waveLayout > 0 && waveLength != NULL && waveSample != NULL ) AddWave(ch, t, waveLength[ch], waveSample[ch]);
+    nHit ++;
   }
+  CountEvent(timeStamp, isCompact ? nHit : NumChannel);
+  if( isCompact ) DeltaEncode(); /// keep the channel order of the waves
   tree->Fill();
+  IndexEvent(indexE.data(), indexT.data());
+  HandEvent(1, *max_element(indexT.begin(), indexT.end()));
   waveList->Clear();
 
 }
 
 
 
+//############################################ asynchronous writer
+void FileIO::StartWriter(){
+  if( writerRunning ) return;
+  writerStop = false;
+  writerRunning = true;
+  writer = thread(&FileIO::WriterLoop, this);
+  printf("====== File writer thread started.\n");
+}
+
+void FileIO::StopWriter(){
+  if( !writerRunning ) return;
+  {
+    lock_guard<mutex> lock(queueMutex);
+    writerStop = true;
+  }
+  queueCond.notify_all();
+  writer.join();  /// the loop leaves only when the queue is empty
+  writerRunning = false;
+  printf("====== File writer thread stopped, %llu events written.\n", writtenEvent);
+}
+
+void FileIO::Drain(){
+  if( !writerRunning ) return;
+  unique_lock<mutex> lock(queueMutex);
+  drainCond.wait(lock, [this]{ return queue.empty() && !writerBusy; });
+}
+
+EventBatch * FileIO::GetFreeBatch(){
+  EventBatch * batch = NULL;
+  {
+    lock_guard<mutex> lock(queueMutex);
+    if( !pool.empty() ) {
+      batch = pool.back();
+      pool.pop_back();
+    }
+  }
+  if( batch == NULL ) batch = new EventBatch();
+  batch->Reset(NumChannel);
+  return batch;
+}
+
+void FileIO::SetArrowWriter(ArrowWriter * arrow, bool keepTree){
+  lock_guard<recursive_mutex> lock(fileMutex);
+  arrowWriter = arrow;
+  isTreeOutput = keepTree || arrow == NULL;
+}
+
+void FileIO::WriteBatch(EventBatch * batch){
+  Append();
+  if( arrowWriter != NULL ){
+    arrowWriter->Write(batch->nEvent, batch->nChannel, batch->channel.data(), batch->energy.data(), batch->timeStamp.data(), batch->fineTime.data());
+  }
+  for( int ev = 0; ev < batch->nEvent; ev++){
+    int k = ev * batch->nChannel;
+    if( isTreeOutput ) FillTree(&batch->channel[k], &batch->energy[k], &batch->timeStamp[k], &batch->fineTime[k]);
+    if( latency != NULL ) latency->Record(LatencyMonitor::kWriter, batch->hitTime[ev], LatencyMonitor::NowMicroSec());
+  }
+}
+
+bool FileIO::PushBatch(EventBatch * batch, ULong64_t * droppedHit){
+  if( writerRunning ){
+    unique_lock<mutex> lock(queueMutex);
+    if( droppedHit == NULL ) drainCond.wait(lock, [this]{ return (int) queue.size() < maxQueue; });
+    if( (int) queue.size() >= maxQueue ){ /// the disk is behind, the read-out is not blocked
+      for( int k = 0; k < batch->nEvent * batch->nChannel; k++){
+        if( batch->channel[k] >= 0 ) droppedHit[k % batch->nChannel] ++;
+      }
+      droppedEvent += batch->nEvent;
+      pool.push_back(batch);
+      return false;
+    }
+  }
+  ULong64_t lastTime = 0; /// of the last event, for the journal
+  for( int ch = 0; ch < batch->nChannel && batch->nEvent > 0; ch++){
+    int k = (batch->nEvent - 1) * batch->nChannel + ch;
+    if( batch->channel[k] >= 0 && batch->timeStamp[k] > lastTime ) lastTime = batch->timeStamp[k];
+  }
+  HandEvent(batch->nEvent, lastTime);
+  if( !writerRunning ){ /// no thread, write it here
+    lock_guard<recursive_mutex> lock(fileMutex);
+    WriteBatch(batch);
+    writtenEvent += batch->nEvent;
+    lock_guard<mutex> qLock(queueMutex);
+    pool.push_back(batch);
+    return true;
+  }
+  {
+    lock_guard<mutex> lock(queueMutex);
+    queue.push_back(batch);
+    if( (int) queue.size() > maxQueueDepth ) maxQueueDepth = queue.size();
+  }
+  queueCond.notify_one();
+  return true;
+}
+
+int FileIO::GetQueueDepth(){
+  lock_guard<mutex> lock(queueMutex);
+  return queue.size();
+}
+
+void FileIO::WriterLoop(){
+
+  while( true ){
+    EventBatch * batch = NULL;
+    {
+      unique_lock<mutex> lock(queueMutex);
+      queueCond.wait(lock, [this]{ return !queue.empty() || writerStop; });
+      if( queue.empty() ) break; /// stop and nothing left
+      batch = queue.front();
+      queue.pop_front();
+      writerBusy = true;
+    }
+
+    double t0 = LatencyMonitor::NowMicroSec() * 1e-6;
+    {
+      lock_guard<recursive_mutex> lock(fileMutex);
+      WriteBatch(batch);
+      bool isMore;
+      {
+        lock_guard<mutex> qLock(queueMutex);
+        isMore = !queue.empty();
+      }
+      if( persistent || !isMore ) {
+        AutoSaveIfDue();
+      }else{
+        RolloverIfDue(); /// keep the file open for the next batch
+      }
+      UpdateTreeSize();
+    }
+    double t1 = LatencyMonitor::NowMicroSec() * 1e-6;
+
+    {
+      lock_guard<mutex> lock(queueMutex);
+      writtenEvent += batch->nEvent;
+      writerBusySec += t1 - t0;
+      pool.push_back(batch);
+      writerBusy = false;
+    }
+    drainCond.notify_all();
+  }
+
+  drainCond.notify_all();
+}
+
+void FileIO::PrintWriterStatistic(){
+  if( !writerRunning ){
+    lock_guard<recursive_mutex> lock(fileMutex);
+    UpdateTreeSize();
+  }
+  double size = fileSizeMB;
+  double totMB = treeTotMB;
+  double zipMB = treeZipMB;
+  lock_guard<mutex> lock(queueMutex);
+  time_t now = time(NULL);
+  double dt = difftime(now, lastPrintTime);
+  if( dt <= 0 ) dt = 1;
+  printf(" Writer %-8s | queue %3d/%3d (max %3d) | %10llu events | %8.1f ev/s | busy %5.1f%%",
+           writerRunning ? "(thread)" : "(inline)", (int) queue.size(), maxQueue, maxQueueDepth, writtenEvent,
+           (writtenEvent - lastPrintEvent) / dt, (writerBusySec - lastPrintBusySec) / dt * 100.);
+  if( droppedEvent > 0 ) printf(" | dropped %llu events, queue full", droppedEvent);
+  printf("\n");
+  printf(" Compression %-12s | raw %7.2f MB/s | disk %7.2f MB/s | ratio %5.2f\n",
+           GetCompressionName().Data(), (totMB - lastPrintTotMB) / dt, (size - lastPrintSize) / dt, zipMB > 0 ? totMB / zipMB : 0.);
+  lastPrintTime = now;
+  lastPrintEvent = writtenEvent;
+  lastPrintSize = size;
+  lastPrintTotMB = totMB;
+  lastPrintBusySec = writerBusySec;
+}
+
 #endif
@@ -0,0 +1,70 @@
+#ifndef FILESNAPSHOT
+#define FILESNAPSHOT
+
+#include <stdio.h>
+#include <ctime>
+#include "TString.h"
+#include "TSystem.h"
+
+/// The snapshot of a root file being written, for a reader following the run ( BoxScoreReader -f ).
+/// FileIO publishes it after each AutoSave, or each Close in the re-open mode, when the tree on disk
+/// is consistent up to "entries". It is one line in base.snapshot, next to the root file,
+///   fileName  entries  unixTime  open/end
+/// written into a temporary file and renamed, so the reader never sees half of it.
+/// base is the root file without .root, or the run name without _000 with rollover.
+
+class FileSnapshot{
+public:
+
+  FileSnapshot() { entries = 0; time = 0; isEnd = false; }
+
+  TString  fileName;   /// the root file, the current segment with rollover
+  Long64_t entries;    /// of the tree, consistent on disk
+  time_t   time;
+  bool     isEnd;      /// the run is over, no more entries
+
+  bool Write(TString snapshotName);
+  bool Read(TString snapshotName);
+
+  static TString GetName(TString rootFile); /// snapshot of a root file, or of the run for a segment
+};
+
+bool FileSnapshot::Write(TString snapshotName){
+  TString tempName = snapshotName + ".tmp";
+  FILE * out = fopen(tempName.Data(), "w");
+  if( out == NULL ) return false;
+  fprintf(out, "%s %lld %ld %s\n", fileName.Data(), entries, (long) time, isEnd ? "end" : "open");
+  fclose(out);
+  return rename(tempName.Data(), snapshotName.Data()) == 0;
+}
+
+bool FileSnapshot::Read(TString snapshotName){
+  FILE * in = fopen(snapshotName.Data(), "r");
+  if( in == NULL ) return false;
+  char name[1024], state[16];
+  long long n = 0;
+  long t = 0;
+  int nRead = fscanf(in, "%1023s %lld %ld %15s", name, &n, &t, state);
+  fclose(in);
+  if( nRead != 4 ) return false;
+  fileName = name;
+  entries = n;
+  time = t;
+  isEnd = TString(state) == "end";
+  return true;
+}
+
+TString FileSnapshot::GetName(TString rootFile){
+  TString base = rootFile;
+  if( base.EndsWith(".root") ) base.Remove(base.Length() - 5);
+  if( !gSystem->AccessPathName(base + ".snapshot") ) return base + ".snapshot";
+
+  /// a segment, run_003 -> run
+  int underscore = base.Last('_');
+  if( underscore > 0 && base.Length() - underscore == 4 && TString(base(underscore + 1, 3)).IsDigit() ){
+    base.Remove(underscore);
+  }
+  return base + ".snapshot";
+}
+
+#endif
@@ -23,6 +23,8 @@
 #include "TLine.h"
 #include "TMacro.h"
 
+#include "HistogramCheckpoint.h"
+
 #include <thread>
 
 #define numChannel 16
@@ -32,7 +34,7 @@ using namespace std;
 class GenericPlane{
   RQ_OBJECT("GenericPlane")
 public:
-  GenericPlane();
+  GenericPlane(bool withCanvas = true); /// false for a shard, only the histograms, filled by another thread
   ~GenericPlane();
 
   void         SetChannelMask(bool ch7, bool ch6, bool ch5, bool ch4, bool ch3, bool ch2, bool ch1, bool ch0);
@@ -50,6 +52,7 @@ public:
   void         SetHistogramsRange();
   void         SetChannelsPlotRange(int ** range);
   void         SetTesting() { isTesting = true; };
+  void         SetTimeStampUnit(double nsPerTick) { tick2ns = nsPerTick; }; /// time unit of times[] in Fill, default 1 ch = 2 ns
 
   void         Fill(UInt_t  dE, UInt_t E);
   virtual void Fill(UInt_t * energy, ULong64_t * times);
@@ -83,6 +86,20 @@ public:
   void         LoadCuts(TString cutFileName);
   void         CutCreator();
 
+  ///=========== histogram registry, every histogram to be saved is registered, also by the derivative Class
+  void         RegisterHistogram(TObject * obj);
+  void         RegisterCutHistogram(TObject * obj);         /// filled only inside a cut, re-filled when the cuts change
+  vector<TObject *> GetHistogramList() {return histList;}
+  bool         IsCutHistogram(int i) {return histCut[i];}
+  void         SetCheckpoint(TString fileName, double sec);  /// background copy of the changed histograms every sec
+  int          CheckpointIfDue(bool force = false);         /// number of histograms handed to the writer
+  void         EndCheckpoint(bool remove);                  /// remove the file when every histogram is saved elsewhere
+  HistogramCheckpoint * GetCheckpoint() {return checkpoint;}
+  void         MergeShard(GenericPlane * shard);           /// add the histograms and cut counts of a shard of the same Class
+  void         RestoreRateGraph(TMultiGraph * graph);      /// the points of a saved rate graph, same cuts
+  void         SetCutOnly(bool on) {isCutOnly = on;}       /// Fill() only the cut counts and the cut histograms
+  bool         IsCutOnly()         {return isCutOnly;}
+
   string GetLocation()             {return location;}
   string GetClassName()            {return className;}
   int    GetClassID()              {return classID;}
@@ -111,6 +128,7 @@ public:
 
   TObjArray * GetCutList()  {return cutList;}
   int GetCountOfCut (int i) {if( countOfCut.size() <= i ) return -404; return countOfCut[i];}
+  void SetCountOfCut(int i, int count) {if( i < (int) countOfCut.size() ) countOfCut[i] = count;}
   int GetNumCut()           {return numCut;}
 
   TString GetCutName(int i) {cutG = (TCutG*) cutList->At(i); return cutG->GetName();}
@@ -146,6 +164,7 @@ protected:
   int rangeE[2];  // range for E
   int histBins;
   double rangeTime;  // range for Tdiff, nano-sec
+  double tick2ns;    // nano-sec per time stamp unit
 
   TCanvas *fCanvas;
 ///  TCanvas *gCanvas;
@@ -193,6 +212,7 @@ protected:
   int mode;
 
   bool isHistogramSet;
+  bool isCutOnly;
 
   TGraph * graphRate;
   TGraph ** graphRateCut;
@@ -204,6 +224,16 @@ private:
   int graphIndex;
   bool isTesting;
 
+  vector<TObject *> histList;
+  vector<bool> histCut;         /// depends on the cuts
+  vector<double> histStamp;     /// entries at the last checkpoint, -1 = never saved
+  vector<double> histWeight;    /// sum of weights at the last checkpoint
+  HistogramCheckpoint * checkpoint;
+  double checkpointSec;
+  time_t lastCheckpoint;
+
+  static double GetHistogramStamp(TObject * obj, double &weight);
+
   void DrawEmptyWave(int length, int padID, int waveIndex);
 
 };
@@ -213,6 +243,8 @@ GenericPlane::~GenericPlane(){
 
   printf("cleaning up GenericPlane \n");
 
+  delete checkpoint;
+
   delete fCanvas;
 ///  delete gCanvas;
   delete hE;
@@ -250,7 +282,7 @@ GenericPlane::~GenericPlane(){
 
 }
 
-GenericPlane::GenericPlane(){
+GenericPlane::GenericPlane(bool withCanvas){
 
   //======= className, classID, location muse be unique and declared in every derivative Class.
   className = "GenericPlane";
@@ -267,13 +299,17 @@ GenericPlane::GenericPlane(){
   rangeE[1] =  60000; /// max range for E
   histBins  =   1000; /// num bins for dE & E
   rangeTime =    500; /// range for Tdiff, nano-sec
+  tick2ns   =    2.0; /// 1 ch = 2 ns, coarse time stamp
 
   NChannelForRealEvent = 8;  /// this is the number of channel for a real event;
 
-  fCanvas = new TCanvas("fCanvas", "Main Canvas (Generic Plane)", 0, 0, 1000, 1000);
-  gStyle->SetOptStat("neiou");
-  if( fCanvas->GetShowEditor() ) fCanvas->ToggleEditor();
-  if( fCanvas->GetShowToolBar() ) fCanvas->ToggleToolBar();
+  fCanvas = NULL;
+  if( withCanvas ){
+    fCanvas = new TCanvas("fCanvas", "Main Canvas (Generic Plane)", 0, 0, 1000, 1000);
+    gStyle->SetOptStat("neiou");
+    if( fCanvas->GetShowEditor() ) fCanvas->ToggleEditor();
+    if( fCanvas->GetShowToolBar() ) fCanvas->ToggleToolBar();
+  }
  /// gCanvas = new TCanvas("gCanvas", "testing", 0, 0, 1000, 1000);
  /// gStyle->SetOptStat("neiou");
  /// if( gCanvas->GetShowEditor() ) gCanvas->ToggleEditor();
@@ -335,6 +371,11 @@ GenericPlane::GenericPlane(){
 
   isHistogramSet = false;
   isTesting = false;
+  isCutOnly = false;
+
+  checkpoint = NULL;
+  checkpointSec = 0;
+  lastCheckpoint = 0;
 
 }
 
@@ -459,6 +500,7 @@ void GenericPlane::SetGenericHistograms(){
   hDetIDHit = new TH2F("hDetIDHit", "ch vs hit; hit; ch", 8, -0.5, 7.5, 8, -0.5, 7.5);
 
   rateGraph = new TMultiGraph();
+  rateGraph->SetName("rateGraph");
   rateGraph->SetTitle("Beam rate [pps]; Time [sec]; Rate [pps]");
 
   legend = new TLegend( 0.9, 0.2, 0.99, 0.8);
@@ -478,6 +520,19 @@ void GenericPlane::SetGenericHistograms(){
   rateGraph->Add(rangeGraph);
   rateGraph->Add(graphRate);
 
+  for( int i = 0 ; i < numChannel ; i++) RegisterHistogram(hch[i]);
+  RegisterHistogram(hE);
+  RegisterHistogram(hdE);
+  RegisterHistogram(hdT);
+  RegisterHistogram(hdEE);
+  RegisterHistogram(htotE);
+  RegisterHistogram(hdEtotE);
+  RegisterHistogram(hTDiff);
+  RegisterHistogram(hdEdT);
+  RegisterHistogram(hHit);
+  RegisterHistogram(hDetIDHit);
+  RegisterHistogram(rateGraph);
+
   isHistogramSet = true;
 
 }
@@ -518,6 +573,7 @@ void GenericPlane::Fill(UInt_t * energy, ULong64_t * times){
   
   if( isTesting ) {
     
+    if( isCutOnly ) return; /// no cut in testing
     for( int ch = 0; ch < numChannel ; ch++){
       if (  !(ChannelMask & (1<<ch)) ) continue;
       hch[ch]->Fill(energy[ch]);
@@ -533,27 +589,29 @@ void GenericPlane::Fill(UInt_t * energy, ULong64_t * times){
     unsigned long long int T = times[chT]; //
     float chan2ns = 2.0e-9; //converts times to seconds
     //~ float dEdT = (float)T*chan2ns - (float)dET*chan2ns; // dE - T time diff only for now
-    float dEdT = (float)(T - dET);// dE - T time diff only for now
-    dEdT = dEdT*2.0; //ch2ns
+    float dEdT = (float)((Long64_t)(T - dET));// dE - T time diff only for now
+    dEdT = dEdT*tick2ns; //to ns, fine time stamp when available
     //~ printf("T: %1.12f, dET: %1.12f dEdT: %12.12f\n",
     //~ (float)T*chan2ns,(float)dET*chan2ns, dEdT);
 
-    //'raw' fills
-    hE->Fill(E);
-    hdE->Fill(dE);
-    hdT->Fill(dEdT);
-    hdEE->Fill(E, dE);
-    hdEdT->Fill(dEdT, dE);//
-
-    //cal fills  
-    float calE[2] = {1.0,0.0};
-    float totEcal = (float)dE * chdEGain + (float)E * chEGain;
-    totEcal = calE[0]*totEcal + calE[1];
-    float dEcal = (float)dE * chdEGain;
-    dEcal = calE[0]*dEcal + calE[1];
-    
-    hdEtotE->Fill(totEcal, dEcal);
-    htotE->Fill(totEcal);
+    if( !isCutOnly ){
+      //'raw' fills
+      hE->Fill(E);
+      hdE->Fill(dE);
+      hdT->Fill(dEdT);
+      hdEE->Fill(E, dE);
+      hdEdT->Fill(dEdT, dE);//
+
+      //cal fills  
+      float calE[2] = {1.0,0.0};
+      float totEcal = (float)dE * chdEGain + (float)E * chEGain;
+      totEcal = calE[0]*totEcal + calE[1];
+      float dEcal = (float)dE * chdEGain;
+      dEcal = calE[0]*dEcal + calE[1];
+      
+      hdEtotE->Fill(totEcal, dEcal);
+      htotE->Fill(totEcal);
+    }
 
     if( numCut > 0  ){
       for( int i = 0; i < numCut; i++){
@@ -575,6 +633,117 @@ void GenericPlane::FillWaveEnergies(double * energy){
     hdEE->Fill(energy[chE], energy[chdE]);
 }
 
+void GenericPlane::MergeShard(GenericPlane * shard){
+  /// same Class, so the histograms were registered in the same order
+  for( int i = 0; i < (int) histList.size() && i < (int) shard->histList.size(); i++){
+    if( !histList[i]->InheritsFrom("TH1") || !shard->histList[i]->InheritsFrom("TH1") ) continue; /// the rate graph is re-built by the caller
+    ((TH1*) histList[i])->Add((TH1*) shard->histList[i]);
+  }
+  for( int i = 0; i < (int) countOfCut.size() && i < (int) shard->countOfCut.size(); i++) countOfCut[i] += shard->countOfCut[i];
+}
+
+void GenericPlane::RegisterHistogram(TObject * obj){
+  if( obj == NULL ) return;
+  for( int i = 0; i < (int) histList.size(); i++) if( histList[i] == obj ) return;
+  histList.push_back(obj);
+  histCut.push_back(false);
+  histStamp.push_back(-1);
+  histWeight.push_back(0);
+}
+
+void GenericPlane::RegisterCutHistogram(TObject * obj){
+  RegisterHistogram(obj);
+  for( int i = 0; i < (int) histList.size(); i++) if( histList[i] == obj ) histCut[i] = true;
+}
+
+void GenericPlane::RestoreRateGraph(TMultiGraph * graph){
+  /// the graphs in the order of Add(), the range, the total, then one per cut
+  TList * from = graph->GetListOfGraphs();
+  TList * to = rateGraph->GetListOfGraphs();
+  if( from == NULL || to == NULL ) return;
+  for( int i = 0; i < from->GetSize() && i < to->GetSize(); i++){
+    TGraph * src = (TGraph *) from->At(i);
+    TGraph * dst = (TGraph *) to->At(i);
+    dst->Set(0);
+    for( int k = 0; k < src->GetN(); k++) dst->SetPoint(k, src->GetX()[k], src->GetY()[k]);
+  }
+  graphIndex = graphRate->GetN();
+}
+
+double GenericPlane::GetHistogramStamp(TObject * obj, double &weight){
+  weight = 0;
+  if( obj->InheritsFrom("TH1") ){ /// a Fill or a Reset changes either, an Add() or SetBinContent() may keep the entries
+    weight = ((TH1*) obj)->GetSumOfWeights();
+    return ((TH1*) obj)->GetEntries();
+  }
+  if( obj->InheritsFrom("TMultiGraph") ){
+    double nPoint = 0;
+    TIter next(((TMultiGraph*) obj)->GetListOfGraphs());
+    while( TGraph * graph = (TGraph*) next() ){
+      nPoint += graph->GetN();
+      for( int k = 0; k < graph->GetN(); k++) weight += graph->GetY()[k];
+    }
+    return nPoint;
+  }
+  return -2; /// unknown, always saved
+}
+
+void GenericPlane::SetCheckpoint(TString fileName, double sec){
+  if( sec <= 0 ) return;
+  delete checkpoint;
+  checkpoint = new HistogramCheckpoint(fileName);
+  checkpointSec = sec;
+  lastCheckpoint = time(NULL);
+}
+
+int GenericPlane::CheckpointIfDue(bool force){
+  if( checkpoint == NULL || !checkpoint->IsOpen() ) return 0;
+  time_t now = time(NULL);
+  if( !force && difftime(now, lastCheckpoint) < checkpointSec ) return 0;
+
+  vector<TObject *> clones;
+  vector<int> index;
+  vector<double> stamp, weight;
+  TDirectory::TContext context(nullptr); /// the clones must not go into gDirectory, it can be the output file of FileIO
+  for( int i = 0; i < (int) histList.size(); i++){
+    double w = 0;
+    double s = GetHistogramStamp(histList[i], w);
+    if( s >= 0 && s == histStamp[i] && w == histWeight[i] ) continue; /// unchanged since the last checkpoint
+    TObject * clone = histList[i]->Clone();
+    if( clone->InheritsFrom("TH1") ) ((TH1*) clone)->SetDirectory(0);
+    clones.push_back(clone);
+    index.push_back(i);
+    stamp.push_back(s);
+    weight.push_back(w);
+  }
+
+  if( clones.empty() ) {
+    lastCheckpoint = now;
+    return 0;
+  }
+  if( !checkpoint->Push(clones) ){ /// the writer is behind, try again at the next update
+    for( int k = 0; k < (int) clones.size(); k++) delete clones[k];
+    return 0;
+  }
+  for( int k = 0; k < (int) index.size(); k++){
+    histStamp[index[k]] = stamp[k];
+    histWeight[index[k]] = weight[k];
+  }
+  lastCheckpoint = now;
+  return index.size();
+}
+
+void GenericPlane::EndCheckpoint(bool remove){
+  if( checkpoint == NULL ) return;
+  if( !remove ) {
+    checkpoint->Drain();
+    CheckpointIfDue(true);
+  }
+  checkpoint->Close(remove);
+  delete checkpoint;
+  checkpoint = NULL;
+}
+
 void GenericPlane::FillRateGraph(float x, float y){
   graphRate->SetPoint(graphIndex, x, y);
   graphIndex++;
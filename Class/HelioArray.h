@@ -15,7 +15,7 @@ class HelioArray : public GenericPlane{
   RQ_OBJECT("HelioArray");
 public:
 
-  HelioArray();
+  HelioArray(bool withCanvas = true);
   ~HelioArray();
   
   void SetCanvasTitleDivision(TString titleExtra);
@@ -58,7 +58,7 @@ private:
   
 };
 
-HelioArray::HelioArray(){
+HelioArray::HelioArray(bool withCanvas) : GenericPlane(withCanvas){
     
   //=========== ClassName and ClassID is for class identification in BoxScoreXY
   className = "HelioArray";
@@ -149,6 +149,15 @@ void HelioArray::SetOthersHistograms(){
   
   hE2 = new TH1F("hE3", Form("Energy w/o Ring (ch=%d); [keV]; count / 2 keV", chEnergy), bin, xMin, xMax);
   
+  RegisterHistogram(hEnergy);
+  RegisterHistogram(hXF);
+  RegisterHistogram(hXN);
+  RegisterHistogram(hRing);
+  RegisterHistogram(hXFXN);
+  RegisterHistogram(hEX);
+  RegisterHistogram(hXS);
+  RegisterHistogram(hE2);
+  
 }
 
 void HelioArray::SetCanvasTitleDivision(TString titleExtra = ""){
@@ -188,6 +197,7 @@ void HelioArray::Draw(){
 void HelioArray::Fill(UInt_t * energy){
   
   if ( !isHistogramSet ) return;
+  if ( isCutOnly ) return; /// no histogram of this plane depends on the cuts, they are from the replay cache
   
   //GenericPlane::Fill(energy);
 
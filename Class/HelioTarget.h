@@ -7,7 +7,7 @@ class HeliosTarget : public GenericPlane{
   RQ_OBJECT("HelioTarget");
 public:
 
-  HeliosTarget();
+  HeliosTarget(bool withCanvas = true);
   ~HeliosTarget();
   
   void          SetOthersHistograms();
@@ -34,7 +34,7 @@ private:
   
 };
 
-HeliosTarget::HeliosTarget(){
+HeliosTarget::HeliosTarget(bool withCanvas) : GenericPlane(withCanvas){
     
   //=========== ClassName and ClassID is for class identification in BoxScoreXY
   className = "HeliosTarget";
@@ -141,6 +141,17 @@ void HeliosTarget::SetOthersHistograms(){
   
   hdE->SetTitle("raw dE(Y1+Y2)");;
   
+  RegisterHistogram(hX);
+  RegisterHistogram(hY);
+  RegisterHistogram(hXY);
+  RegisterCutHistogram(hXg);
+  RegisterCutHistogram(hYg);
+  RegisterCutHistogram(hXYg);
+  RegisterHistogram(hX1);
+  RegisterHistogram(hX2);
+  RegisterHistogram(hY1);
+  RegisterHistogram(hY2);
+  
   isHistogramSet = true;
   
   printf(" Histograms set \n");
@@ -240,27 +251,29 @@ void HeliosTarget::Fill(UInt_t * energy, ULong64_t * times){
   if( energy[chY1] !=0 && energy[chY2] !=0 )
     Y = ((float)energy[chY1] - (float)energy[chY2])/((float)energy[chY1] + (float)energy[chY2]);
 
-  hX1->Fill(energy[chX1]);
-  hX2->Fill(energy[chX2]);
-  hY1->Fill(energy[chY1]);
-  hY2->Fill(energy[chY2]);
+  if( !isCutOnly ){
+    hX1->Fill(energy[chX1]);
+    hX2->Fill(energy[chX2]);
+    hY1->Fill(energy[chY1]);
+    hY2->Fill(energy[chY2]);
 
- /// if (canID == 2) {
- ///   hX->Reset();
- ///   hY->Reset();
- ///   hXY->Reset();
- /// }
-  if( X != 0.0 ) hX->Fill(X);
-  if( Y != 0.0 ) hY->Fill(Y);
-  if (X != 0.0 && Y != 0.0)
-    hXY->Fill(X, Y);
-  
-  hE->Fill(E);
-  hdE->Fill(dE);
-  hdEE->Fill(E, dE);
-  
-  float totalE = dE * chdEGain + E * chEGain;
-  hdEtotE->Fill(totalE, dE);
+   /// if (canID == 2) {
+   ///   hX->Reset();
+   ///   hY->Reset();
+   ///   hXY->Reset();
+   /// }
+    if( X != 0.0 ) hX->Fill(X);
+    if( Y != 0.0 ) hY->Fill(Y);
+    if (X != 0.0 && Y != 0.0)
+      hXY->Fill(X, Y);
+    
+    hE->Fill(E);
+    hdE->Fill(dE);
+    hdEE->Fill(E, dE);
+    
+    float totalE = dE * chdEGain + E * chEGain;
+    hdEtotE->Fill(totalE, dE);
+  }
   
   if( numCut > 0  ){
     for( int i = 0; i < numCut; i++){
@@ -0,0 +1,173 @@
+#ifndef HISTOGRAMCHECKPOINT
+#define HISTOGRAMCHECKPOINT
+
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "TString.h"
+#include "TFile.h"
+#include "TDirectory.h"
+#include "TSystem.h"
+
+using namespace std;
+
+/// Background writer of the histogram checkpoints of GenericPlane, into base.histo.root next to the root file.
+/// The plane clones the histograms changed since the last checkpoint and hands the clones over with Push(),
+/// the writer thread writes them ( a new key, then the old one is deleted ) and saves the key list, so the
+/// file on disk always has the last complete copy of every histogram. After a crash it is opened as usual,
+/// ROOT recovers the keys, at most one checkpoint interval of histogram filling is lost.
+/// Push() never waits, it refuses the checkpoint while the previous one is still being written.
+
+class HistogramCheckpoint{
+public:
+
+  HistogramCheckpoint(TString fileName);
+  ~HistogramCheckpoint();
+
+  bool IsOpen()             {return file != NULL;}
+  TString GetFileName()     {return fileName;}
+
+  bool Push(vector<TObject *> &clones); /// takes the clones, false if busy, the clones are then left to the caller
+  void Drain();                         /// wait until the last checkpoint is on disk
+  void Close(bool remove);              /// remove the file, e.g. when every histogram is in the root file
+
+  void PrintStatistic();
+
+private:
+
+  TString fileName;
+  TFile * file;
+
+  mutex queueMutex;
+  condition_variable queueCond;
+  condition_variable drainCond;
+  vector<TObject *> pending;
+  bool hasPending;
+  bool writerStop;
+  bool writerBusy;
+  thread writer;
+
+  int nCheckpoint;
+  int nRefused;
+  ULong64_t nWritten;
+  double lastWriteMs;
+  double maxWriteMs;
+
+  void WriterLoop();
+};
+
+HistogramCheckpoint::HistogramCheckpoint(TString fileName){
+
+  this->fileName = fileName;
+  hasPending = false;
+  writerStop = false;
+  writerBusy = false;
+  nCheckpoint = 0;
+  nRefused = 0;
+  nWritten = 0;
+  lastWriteMs = 0;
+  maxWriteMs = 0;
+
+  {
+    TDirectory::TContext context; /// keep gDirectory, new histograms must not go into this file
+    file = new TFile(fileName, "RECREATE");
+  }
+  if( file->IsZombie() ){
+    printf("cannot open histogram checkpoint %s\n", fileName.Data());
+    delete file;
+    file = NULL;
+    return;
+  }
+
+  writer = thread(&HistogramCheckpoint::WriterLoop, this);
+  printf("====== Histogram checkpoint : %s\n", fileName.Data());
+}
+
+HistogramCheckpoint::~HistogramCheckpoint(){
+  Close(false);
+}
+
+bool HistogramCheckpoint::Push(vector<TObject *> &clones){
+  if( file == NULL ) return false;
+  {
+    lock_guard<mutex> lock(queueMutex);
+    if( hasPending || writerBusy ) {
+      nRefused ++;
+      return false;
+    }
+    pending.swap(clones);
+    hasPending = true;
+  }
+  clones.clear();
+  queueCond.notify_one();
+  return true;
+}
+
+void HistogramCheckpoint::Drain(){
+  if( file == NULL ) return;
+  unique_lock<mutex> lock(queueMutex);
+  drainCond.wait(lock, [this]{ return !hasPending && !writerBusy; });
+}
+
+void HistogramCheckpoint::Close(bool remove){
+  if( file == NULL ) return;
+  {
+    lock_guard<mutex> lock(queueMutex);
+    writerStop = true;
+  }
+  queueCond.notify_all();
+  writer.join();
+
+  file->Close();
+  delete file;
+  file = NULL;
+  if( remove ) gSystem->Unlink(fileName);
+}
+
+void HistogramCheckpoint::WriterLoop(){
+
+  while( true ){
+    vector<TObject *> list;
+    {
+      unique_lock<mutex> lock(queueMutex);
+      queueCond.wait(lock, [this]{ return hasPending || writerStop; });
+      if( !hasPending ) break; /// stop and nothing left
+      list.swap(pending);
+      hasPending = false;
+      writerBusy = true;
+    }
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    file->cd();
+    for( int i = 0; i < (int) list.size(); i++){
+      list[i]->Write("", TObject::kWriteDelete);
+      delete list[i];
+    }
+    file->SaveSelf(kTRUE); /// the key list, so the file opens without recovery
+    file->Flush();
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+
+    {
+      lock_guard<mutex> lock(queueMutex);
+      nCheckpoint ++;
+      nWritten += list.size();
+      lastWriteMs = ms;
+      if( ms > maxWriteMs ) maxWriteMs = ms;
+      writerBusy = false;
+    }
+    drainCond.notify_all();
+  }
+
+  drainCond.notify_all();
+}
+
+void HistogramCheckpoint::PrintStatistic(){
+  lock_guard<mutex> lock(queueMutex);
+  printf(" Histo checkpoint | %5d saved, %3d skipped (busy) | %8llu histograms | last %6.1f ms, max %6.1f ms\n",
+           nCheckpoint, nRefused, nWritten, lastWriteMs, maxWriteMs);
+}
+
+#endif
@@ -132,6 +132,15 @@ void IsoDetect::SetOthersHistograms(){
   hG24 = new TH2F("hG24", Form("G24 (ch=%d, ch=%d); [keV]; [keV]", chG2, chG4), bin, xMin, xMax, bin, xMin, xMax);
   hG41 = new TH2F("hG41", Form("G41 (ch=%d, ch=%d); [keV]; [keV]", chG4, chG1), bin, xMin, xMax, bin, xMin, xMax);
 
+  RegisterHistogram(hG1);
+  RegisterHistogram(hG2);
+  RegisterHistogram(hG3);
+  RegisterHistogram(hG4);
+  RegisterHistogram(hG);
+  RegisterHistogram(hG12);
+  RegisterHistogram(hG24);
+  RegisterHistogram(hG41);
+
   ///hG1->GetXaxis()->SetLabelSize(labelSize);
   ///hG1->GetYaxis()->SetLabelSize(labelSize);
   ///
@@ -0,0 +1,137 @@
+#ifndef LATENCYMONITOR
+#define LATENCYMONITOR
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <mutex>
+#include "TString.h"
+#include "TH1F.h"
+
+/// Hit-to-event latency, i.e. the time between the read-out of the newest hit of an event
+/// and the moment the event reaches a given stage. Kept in log-scale buckets, 10 per decade
+/// from 1 us to 100 sec, so that a run of any length costs a fixed and small memory.
+
+#define LatencyNDecade   8
+#define LatencyBinPerDec 10
+#define LatencyNBin      (LatencyNDecade * LatencyBinPerDec)
+
+class LatencyMonitor {
+public:
+
+  enum Stage { kBuild = 0, kWriter = 1, kFiller = 2, NStage = 3 };
+
+  LatencyMonitor();
+  ~LatencyMonitor(){};
+
+  static ULong64_t NowMicroSec(){
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void Record(int stage, ULong64_t hitTime, ULong64_t arriveTime);
+  void Clear();
+
+  ULong64_t GetCount(int stage)      {return count[stage];}
+  double    GetMax(int stage)        {return maxLatency[stage];}  /// in us
+  double    GetPercentile(int stage, double fraction); /// in us, upper edge of the bucket
+
+  TString   GetStageName(int stage);
+  TH1F *    MakeHistogram(int stage); /// caller owns the histogram
+
+  void Print();
+
+private:
+
+  ULong64_t bucket[NStage][LatencyNBin + 2]; /// 0 = underflow ( < 1 us ), LatencyNBin + 1 = overflow
+  ULong64_t count[NStage];
+  double    maxLatency[NStage];
+
+  std::mutex monitorMutex; /// stages are recorded from different threads
+
+  double GetBinLowEdge(int bin) { return pow(10., (bin - 1) * 1.0 / LatencyBinPerDec);} /// bin = 1 .. LatencyNBin + 1
+};
+
+LatencyMonitor::LatencyMonitor(){
+  Clear();
+}
+
+void LatencyMonitor::Clear(){
+  std::lock_guard<std::mutex> lock(monitorMutex);
+  for( int s = 0; s < NStage; s++){
+    for( int i = 0; i < LatencyNBin + 2; i++) bucket[s][i] = 0;
+    count[s] = 0;
+    maxLatency[s] = 0;
+  }
+}
+
+void LatencyMonitor::Record(int stage, ULong64_t hitTime, ULong64_t arriveTime){
+  if( stage < 0 || stage >= NStage ) return;
+
+  double latency = arriveTime > hitTime ? (double)(arriveTime - hitTime) : 0.;
+
+  int bin = 0;
+  if( latency >= 1. ){
+    bin = 1 + (int) floor(log10(latency) * LatencyBinPerDec);
+    if( bin > LatencyNBin ) bin = LatencyNBin + 1;
+  }
+
+  std::lock_guard<std::mutex> lock(monitorMutex);
+  bucket[stage][bin] ++;
+  count[stage] ++;
+  if( latency > maxLatency[stage] ) maxLatency[stage] = latency;
+}
+
+double LatencyMonitor::GetPercentile(int stage, double fraction){
+  if( count[stage] == 0 ) return 0;
+
+  ULong64_t target = (ULong64_t) ceil(count[stage] * fraction);
+  if( target == 0 ) target = 1;
+
+  ULong64_t sum = 0;
+  for( int i = 0; i < LatencyNBin + 2; i++){
+    sum += bucket[stage][i];
+    if( sum >= target ) {
+      if( i > LatencyNBin ) return maxLatency[stage];
+      double edge = GetBinLowEdge(i + 1);
+      return edge < maxLatency[stage] ? edge : maxLatency[stage];
+    }
+  }
+  return maxLatency[stage];
+}
+
+TString LatencyMonitor::GetStageName(int stage){
+  switch(stage){
+    case kBuild:  return "build";
+    case kWriter: return "writer";
+    case kFiller: return "filler";
+  }
+  return "unknown";
+}
+
+TH1F * LatencyMonitor::MakeHistogram(int stage){
+  std::lock_guard<std::mutex> lock(monitorMutex);
+
+  double edge[LatencyNBin + 1];
+  for( int i = 0; i <= LatencyNBin; i++) edge[i] = GetBinLowEdge(i + 1);
+
+  TString name  = "hLatency_" + GetStageName(stage);
+  TString title;
+  title.Form("hit-to-%s latency; latency [us]; count", GetStageName(stage).Data());
+
+  TH1F * h = new TH1F(name, title, LatencyNBin, edge);
+  for( int i = 0; i < LatencyNBin + 2; i++) h->SetBinContent(i, bucket[stage][i]);
+  h->SetEntries(count[stage]);
+
+  return h;
+}
+
+void LatencyMonitor::Print(){
+  std::lock_guard<std::mutex> lock(monitorMutex);
+  printf(" %-18s| %10s| %10s| %10s| %10s\n", "hit-to-X latency", "events", "p50 [ms]", "p99 [ms]", "max [ms]");
+  for( int s = 0; s < NStage; s++){
+    printf(" %-18s| %10llu| %10.3f| %10.3f| %10.3f\n", GetStageName(s).Data(), count[s],
+                         GetPercentile(s, 0.50)/1000., GetPercentile(s, 0.99)/1000., maxLatency[s]/1000.);
+  }
+}
+
+#endif
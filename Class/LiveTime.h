@@ -0,0 +1,227 @@
+#ifndef LIVETIME
+#define LIVETIME
+
+#include <stdio.h>
+#include <chrono>
+#include "TString.h"
+#include "TTree.h"
+
+/// Dead-time and live-time accounting of a board.
+///
+/// For each channel, a trigger seen by the board ends up as
+///   accepted  = read out with an energy and put into the event builder
+///   pile-up   = read out, energy rejected by the DPP ( PurCnt )
+///   lost      = never read out, flagged by the board in Extras2
+///   dropped   = read out, but thrown away by the software ( full buffer, cleared buffer )
+/// live fraction = accepted / ( read out + lost ). Counted apart, outside the live fraction, as the
+/// hits are still built and filled into the histograms
+///   prescaled  = a single not written to the tree by the write policy ( WritePolicy.h )
+///   rawDropped = not in the raw hit stream, its buffers full
+/// The board time is split into
+/// running and paused ( StopACQ to StartACQ ), live time = running time x live fraction.
+
+#define LostTriggerPerFlag 1024   /// Extras2[12] is set once every 1024 lost triggers
+
+class LiveTime {
+public:
+
+  LiveTime();
+  ~LiveTime(){};
+
+  static double NowSec(){
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() * 1e-6;
+  }
+
+  void Clear();
+  void Start();  /// acquisition started
+  void Stop();   /// acquisition stopped
+
+  void AddTrigger(int ch)              {trigger[ch] ++;}
+  void AddPileUp(int ch)               {pileUp[ch] ++;}
+  void AddDropped(int ch, int n = 1)   {dropped[ch] += n;}
+  void AddPrescaled(int ch)            {prescaled[ch] ++;}
+  void AddRawDropped(int ch)           {rawDropped[ch] ++;}
+  void AddLostFlags(int ch, unsigned int extras2);
+
+  ULong64_t GetTrigger(int ch)   {return trigger[ch];}
+  ULong64_t GetPileUp(int ch)    {return pileUp[ch];}
+  ULong64_t GetDropped(int ch)   {return dropped[ch];}
+  ULong64_t GetPrescaled(int ch) {return prescaled[ch];}
+  ULong64_t GetRawDropped(int ch){return rawDropped[ch];}
+  ULong64_t GetLost(int ch);
+
+  double GetRealTime();          /// sec, since the first Start()
+  double GetPausedTime();        /// sec
+  double GetRunningTime()        {return GetRealTime() - GetPausedTime();}
+
+  double GetLiveFraction(int ch);
+  double GetLiveFraction(unsigned int mask);              /// over the channels in mask
+  double GetLiveTime(unsigned int mask)                   {return GetRunningTime() * GetLiveFraction(mask);}
+
+  void   MarkPeriod(unsigned int mask);                   /// start a new update period for the channels in mask
+  double GetPeriodLiveFraction();                         /// since the last MarkPeriod()
+
+  void   Print(unsigned int mask);
+  TTree* MakeTree(unsigned int mask);                     /// one entry per channel, tree "liveTime"
+
+private:
+
+  ULong64_t trigger[MaxNChannels];
+  ULong64_t pileUp[MaxNChannels];
+  ULong64_t dropped[MaxNChannels];
+  ULong64_t prescaled[MaxNChannels];
+  ULong64_t rawDropped[MaxNChannels];
+  ULong64_t lostEvent[MaxNChannels];  /// number of hits with Extras2[15], at least one lost trigger before
+  ULong64_t lostFlag[MaxNChannels];   /// number of hits with Extras2[12]
+
+  ULong64_t periodAccepted;           /// snapshot at MarkPeriod()
+  ULong64_t periodSeen;
+  unsigned int periodMask;
+
+  double startTime;   /// -1 if never started
+  double stopTime;    /// -1 if running
+  double pausedTime;
+
+  void Sum(unsigned int mask, ULong64_t &accepted, ULong64_t &seen);
+};
+
+LiveTime::LiveTime(){
+  Clear();
+}
+
+void LiveTime::Clear(){
+  for( int ch = 0; ch < MaxNChannels; ch++){
+    trigger[ch] = 0;
+    pileUp[ch] = 0;
+    dropped[ch] = 0;
+    prescaled[ch] = 0;
+    rawDropped[ch] = 0;
+    lostEvent[ch] = 0;
+    lostFlag[ch] = 0;
+  }
+  periodAccepted = 0;
+  periodSeen = 0;
+  periodMask = 0;
+
+  startTime = -1;
+  stopTime = -1;
+  pausedTime = 0;
+}
+
+void LiveTime::Start(){
+  double now = NowSec();
+  if( startTime < 0 ) {
+    startTime = now;
+  }else if( stopTime >= 0 ){
+    pausedTime += now - stopTime;
+  }
+  stopTime = -1;
+}
+
+void LiveTime::Stop(){
+  if( startTime < 0 || stopTime >= 0 ) return;
+  stopTime = NowSec();
+}
+
+void LiveTime::AddLostFlags(int ch, unsigned int extras2){
+  if( extras2 & (1 << 15) ) lostEvent[ch] ++;
+  if( extras2 & (1 << 12) ) lostFlag[ch] ++;
+}
+
+ULong64_t LiveTime::GetLost(int ch){
+  ULong64_t fromFlag = lostFlag[ch] * LostTriggerPerFlag;
+  return fromFlag > lostEvent[ch] ? fromFlag : lostEvent[ch];
+}
+
+double LiveTime::GetRealTime(){
+  if( startTime < 0 ) return 0;
+  return (stopTime >= 0 ? stopTime : NowSec()) - startTime;
+}
+
+double LiveTime::GetPausedTime(){
+  return pausedTime;
+}
+
+void LiveTime::Sum(unsigned int mask, ULong64_t &accepted, ULong64_t &seen){
+  accepted = 0;
+  seen = 0;
+  for( int ch = 0; ch < MaxNChannels; ch++){
+    if( !(mask & (1 << ch)) ) continue;
+    ULong64_t rejected = pileUp[ch] + dropped[ch];
+    accepted += trigger[ch] > rejected ? trigger[ch] - rejected : 0;
+    seen     += trigger[ch] + GetLost(ch);
+  }
+}
+
+double LiveTime::GetLiveFraction(int ch){
+  return GetLiveFraction((unsigned int) (1 << ch));
+}
+
+double LiveTime::GetLiveFraction(unsigned int mask){
+  ULong64_t accepted, seen;
+  Sum(mask, accepted, seen);
+  if( seen == 0 ) return 1.;
+  return accepted * 1.0 / seen;
+}
+
+void LiveTime::MarkPeriod(unsigned int mask){
+  periodMask = mask;
+  Sum(periodMask, periodAccepted, periodSeen);
+}
+
+double LiveTime::GetPeriodLiveFraction(){
+  ULong64_t accepted, seen;
+  Sum(periodMask, accepted, seen);
+  if( seen <= periodSeen || accepted < periodAccepted ) return 1.;
+  return (accepted - periodAccepted) * 1.0 / (seen - periodSeen);
+}
+
+void LiveTime::Print(unsigned int mask){
+  printf(" Live time %.1f / real %.1f sec ( paused %.1f sec ), live fraction %.4f\n",
+                GetLiveTime(mask), GetRealTime(), GetPausedTime(), GetLiveFraction(mask));
+  printf("     | %10s| %10s| %10s| %10s| %10s| %8s| %10s\n", "Trigger", "PileUp", "Lost", "Dropped", "Prescaled", "Live", "RawDropped");
+  for( int ch = 0; ch < MaxNChannels; ch++){
+    if( !(mask & (1 << ch)) ) continue;
+    printf(" Ch %d| %10llu| %10llu| %10llu| %10llu| %10llu| %7.2f%%| %10llu\n", ch, trigger[ch], pileUp[ch], GetLost(ch), dropped[ch], prescaled[ch], GetLiveFraction(ch)*100., rawDropped[ch]);
+  }
+}
+
+TTree * LiveTime::MakeTree(unsigned int mask){
+
+  TTree * tree = new TTree("liveTime", "live time accounting, one entry per channel");
+
+  int ch;
+  ULong64_t trg, pu, lost, drop, pre, rawDrop;
+  double fraction, live, real = GetRealTime(), paused = GetPausedTime(), running = GetRunningTime();
+
+  tree->Branch("ch", &ch, "ch/I");
+  tree->Branch("trigger", &trg, "trigger/l");
+  tree->Branch("pileUp", &pu, "pileUp/l");
+  tree->Branch("lost", &lost, "lost/l");
+  tree->Branch("dropped", &drop, "dropped/l");
+  tree->Branch("prescaled", &pre, "prescaled/l");         /// not in the tree only
+  tree->Branch("rawDropped", &rawDrop, "rawDropped/l");     /// not in the raw hit stream only
+  tree->Branch("liveFraction", &fraction, "liveFraction/D");
+  tree->Branch("liveTime", &live, "liveTime/D");         /// sec
+  tree->Branch("runningTime", &running, "runningTime/D"); /// sec
+  tree->Branch("pausedTime", &paused, "pausedTime/D");    /// sec
+  tree->Branch("realTime", &real, "realTime/D");          /// sec
+
+  for( ch = 0; ch < MaxNChannels; ch++){
+    if( !(mask & (1 << ch)) ) continue;
+    trg = trigger[ch];
+    pu = pileUp[ch];
+    lost = GetLost(ch);
+    drop = dropped[ch];
+    pre = prescaled[ch];
+    rawDrop = rawDropped[ch];
+    fraction = GetLiveFraction(ch);
+    live = running * fraction;
+    tree->Fill();
+  }
+
+  tree->ResetBranchAddresses();
+  return tree;
+}
+
+#endif
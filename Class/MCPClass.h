@@ -116,6 +116,12 @@ void MicroChannelPlate::SetOthersHistograms(){
   
   hXY->SetMinimum(1);
   
+  RegisterHistogram(hX1);
+  RegisterHistogram(hY1);
+  RegisterHistogram(hX2);
+  RegisterHistogram(hY2);
+  RegisterHistogram(hXY);
+  
   isHistogramSet = true;
   
   printf(" Histogram seted. \n");
@@ -0,0 +1,142 @@
+#ifndef RATEMONITOR
+#define RATEMONITOR
+
+#include <stdio.h>
+#include <math.h>
+#include "TString.h"
+
+/// Sliding-window rate estimators driven by the digitizer time stamps.
+/// Each slot (a channel, or any other counter) keeps a ring of time buckets,
+/// a bucket is tagged with its absolute index, so a stale bucket is simply
+/// overwritten and Fill() is O(1). The rate of a window is the sum of the
+/// completed buckets inside it, the bucket that is still filling is not used.
+
+#define NRateWindow 3
+
+class RateMonitor {
+public:
+
+  RateMonitor(int nSlot);
+  ~RateMonitor();
+
+  void SetWindows(double w0, double w1, double w2); /// in sec, ascending
+  double GetWindow(int iWin)  {return window[iWin];}
+
+  void Fill(int slot, double timeNanoSec);
+  void Clear();
+
+  double GetRate(int slot, int iWin);  /// in Hz, -1 if no completed bucket yet
+  double GetNowSec() {return nowBucket < 0 ? 0 : (nowBucket + 1) * bucketWidth * 1e-9;}
+
+private:
+
+  int nSlot;
+  double window[NRateWindow];  /// sec
+  double bucketWidth;          /// ns
+  int    nBucket;              /// ring length, cover the longest window
+
+  Long64_t ** tag;             /// absolute bucket index of the ring slot
+  int      ** count;
+
+  Long64_t firstBucket;
+  Long64_t nowBucket;
+
+  void Allocate();
+  void Free();
+};
+
+RateMonitor::RateMonitor(int nSlot){
+  this->nSlot = nSlot;
+  tag = NULL;
+  count = NULL;
+  SetWindows(1., 10., 60.);
+}
+
+RateMonitor::~RateMonitor(){
+  Free();
+}
+
+void RateMonitor::Free(){
+  if( tag == NULL ) return;
+  for( int i = 0; i < nSlot; i++){
+    delete [] tag[i];
+    delete [] count[i];
+  }
+  delete [] tag;
+  delete [] count;
+  tag = NULL;
+  count = NULL;
+}
+
+void RateMonitor::Allocate(){
+  Free();
+  tag   = new Long64_t * [nSlot];
+  count = new int * [nSlot];
+  for( int i = 0; i < nSlot; i++){
+    tag[i]   = new Long64_t [nBucket];
+    count[i] = new int [nBucket];
+  }
+  Clear();
+}
+
+void RateMonitor::SetWindows(double w0, double w1, double w2){
+  window[0] = w0;
+  window[1] = w1;
+  window[2] = w2;
+  for( int i = 0; i < NRateWindow; i++){
+    if( window[i] <= 0 ) window[i] = pow(10., i);
+  }
+
+  /// the shortest window is divided into 10 buckets
+  bucketWidth = window[0] * 1e9 / 10.;
+  double longest = window[0];
+  for( int i = 1; i < NRateWindow; i++) if( window[i] > longest ) longest = window[i];
+  nBucket = (int) ceil(longest * 1e9 / bucketWidth) + 1;
+
+  Allocate();
+}
+
+void RateMonitor::Clear(){
+  for( int i = 0; i < nSlot; i++){
+    for( int j = 0; j < nBucket; j++){
+      tag[i][j] = -1;
+      count[i][j] = 0;
+    }
+  }
+  firstBucket = -1;
+  nowBucket = -1;
+}
+
+void RateMonitor::Fill(int slot, double timeNanoSec){
+  if( slot < 0 || slot >= nSlot ) return;
+
+  Long64_t idx = (Long64_t) (timeNanoSec / bucketWidth);
+  int k = idx % nBucket;
+
+  if( tag[slot][k] != idx ){
+    tag[slot][k] = idx;
+    count[slot][k] = 0;
+  }
+  count[slot][k] ++;
+
+  if( idx > nowBucket ) nowBucket = idx;
+  if( firstBucket < 0 || idx < firstBucket ) firstBucket = idx;
+}
+
+double RateMonitor::GetRate(int slot, int iWin){
+  if( slot < 0 || slot >= nSlot || nowBucket < 0 ) return -1;
+
+  int n = (int) floor(window[iWin] * 1e9 / bucketWidth + 0.5);
+  if( n > nowBucket - firstBucket ) n = nowBucket - firstBucket; /// only what has been seen since the start
+  if( n <= 0 ) return -1;
+
+  Long64_t low = nowBucket - n;
+  int sum = 0;
+  for( int j = 0; j < nBucket; j++){
+    if( low <= tag[slot][j] && tag[slot][j] < nowBucket ) sum += count[slot][j];
+  }
+
+  return sum / (n * bucketWidth * 1e-9);
+}
+
+#endif
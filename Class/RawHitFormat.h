@@ -0,0 +1,146 @@
+#ifndef RAWHITFORMAT
+#define RAWHITFORMAT
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+/// The raw hit stream, an append-only binary file, little endian as written by the DAQ PC.
+///
+///   file header, RawHitAlign bytes ( RawHitFileHeader + zero padding )
+///   block, block, block, ...
+///
+///   a block = RawHitBlockHeader + nRecord x RawHit + zero padding, blockBytes in total,
+///             blockBytes is a multiple of RawHitAlign, a full block is the writer block size,
+///             the last block of a flush can be shorter.
+///
+/// Every hit read out from the board is there, including pile-up, so the events can be
+/// re-built later with any coincident window.
+
+#define RawHitMagic      "BXSRAW01"
+#define RawHitVersion    1
+#define RawHitAlign      4096
+#define RawBlockMagic    0x4B4C4230   /// "0BLK"
+
+/// RawHit::flags, bit 0-5 = Extras2[15:10] of the DPP-PHA, bit 15 = rejected by the DPP
+#define RawFlagLostTrigger   (1 << 5)  /// Extras2[15], at least one trigger lost before this hit
+#define RawFlagOverRange     (1 << 4)  /// Extras2[14]
+#define RawFlagTrgCounted    (1 << 3)  /// Extras2[13], 1024 triggers counted
+#define RawFlagNLostCounted  (1 << 2)  /// Extras2[12], 1024 lost triggers counted
+#define RawFlagPileUp        (1 << 15) /// energy not valid
+
+struct RawHitFileHeader{   /// 64 bytes
+  char     magic[8];
+  uint32_t version;
+  uint32_t recordSize;      /// sizeof(RawHit)
+  uint32_t align;           /// RawHitAlign
+  uint32_t nChannel;
+  uint32_t channelMask;
+  uint32_t ch2ns;
+  uint32_t fineTimeBits;    /// RawHit::timeStamp = time tag << fineTimeBits + fine time
+  int32_t  serialNumber;
+  uint64_t startTime;       /// unix time of the file creation
+  uint32_t coincidentTimeWindow; /// ns, the one used online, for reference
+  uint32_t reserved[3];
+};
+
+struct RawHitBlockHeader{  /// 16 bytes
+  uint32_t magic;
+  uint32_t nRecord;
+  uint32_t blockBytes;      /// including this header and the padding
+  uint32_t sequence;
+};
+
+struct RawHit{             /// 16 bytes
+  uint64_t timeStamp;       /// in fine-ch
+  uint32_t energy;
+  uint16_t channel;
+  uint16_t flags;
+};
+
+static_assert(sizeof(RawHitFileHeader) == 64, "RawHitFileHeader must be 64 bytes");
+static_assert(sizeof(RawHitBlockHeader) == 16, "RawHitBlockHeader must be 16 bytes");
+static_assert(sizeof(RawHit) == 16, "RawHit must be 16 bytes");
+
+void InitRawHitFileHeader(RawHitFileHeader &header){
+  memset(&header, 0, sizeof(RawHitFileHeader));
+  memcpy(header.magic, RawHitMagic, 8);
+  header.version = RawHitVersion;
+  header.recordSize = sizeof(RawHit);
+  header.align = RawHitAlign;
+}
+
+//############################################ Reader
+class RawHitReader{
+public:
+
+  RawHitReader(){ file = NULL; nBlock = 0; nHit = 0;}
+  ~RawHitReader(){ Close();}
+
+  bool Open(const char * fileName);
+  void Close(){ if( file != NULL ) fclose(file); file = NULL;}
+
+  RawHitFileHeader GetHeader() {return header;}
+
+  /// read the next block, hits are appended to hits, return false at the end of the file
+  bool ReadBlock(std::vector<RawHit> &hits);
+
+  /// go back to the first block
+  void Rewind(){ if( file != NULL ) fseek(file, header.align, SEEK_SET); nBlock = 0; nHit = 0;}
+
+  long long GetNBlockRead() {return nBlock;}
+  long long GetNHitRead()   {return nHit;}
+
+private:
+  FILE * file;
+  RawHitFileHeader header;
+  std::vector<char> buffer;
+  long long nBlock;
+  long long nHit;
+};
+
+bool RawHitReader::Open(const char * fileName){
+  Close();
+  file = fopen(fileName, "rb");
+  if( file == NULL ){
+    printf("cannot open raw hit file %s\n", fileName);
+    return false;
+  }
+  if( fread(&header, sizeof(RawHitFileHeader), 1, file) != 1 || memcmp(header.magic, RawHitMagic, 8) != 0 ){
+    printf("%s is not a raw hit file.\n", fileName);
+    Close();
+    return false;
+  }
+  if( header.recordSize != sizeof(RawHit) ){
+    printf("%s has record size %u, expected %d.\n", fileName, header.recordSize, (int) sizeof(RawHit));
+    Close();
+    return false;
+  }
+  Rewind();
+  return true;
+}
+
+bool RawHitReader::ReadBlock(std::vector<RawHit> &hits){
+  if( file == NULL ) return false;
+
+  RawHitBlockHeader block;
+  if( fread(&block, sizeof(RawHitBlockHeader), 1, file) != 1 ) return false;
+  if( block.magic != RawBlockMagic || block.blockBytes < sizeof(RawHitBlockHeader) ){
+    printf("raw hit file: bad block after %lld blocks, stop reading.\n", nBlock);
+    return false;
+  }
+
+  size_t rest = block.blockBytes - sizeof(RawHitBlockHeader);
+  if( buffer.size() < rest ) buffer.resize(rest);
+  if( fread(buffer.data(), 1, rest, file) != rest ) return false; /// truncated block, e.g. still being written
+
+  const RawHit * rec = (const RawHit *) buffer.data();
+  hits.insert(hits.end(), rec, rec + block.nRecord);
+
+  nBlock ++;
+  nHit += block.nRecord;
+  return true;
+}
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef RAWHITWRITER
+#define RAWHITWRITER
+
+#include <stdio.h>
+#include <string.h>
+#include <ctime>
+#include "TString.h"
+
+#include "RawHitFormat.h"
+#include "BlockWriter.h"
+
+using namespace std;
+
+/// Write every hit read out from the board into a raw hit stream ( see RawHitFormat.h ),
+/// without ROOT. The read-out thread fills the current block with Add(), a full block
+/// is handed to the BlockWriter, which writes it from its own thread. When the writer
+/// cannot keep up and all its buffers are in flight, the hits are thrown away and counted,
+/// the read-out is never blocked. RawHitPoolBlock buffers are allocated at the start, more only
+/// when the disk falls behind, by default up to RawHitMemoryMB, the hits are dropped only after
+/// that much is waiting for the disk.
+
+#define RawHitPoolBlock 8
+#define RawHitMemoryMB  256
+
+class RawHitWriter{
+public:
+
+  RawHitWriter(TString fileName, RawHitFileHeader header, int blockSizeMB = 1, int nBuffer = 0, bool directIO = false, double preallocMB = 256);
+  ~RawHitWriter();
+
+  bool IsOpen() {return block != NULL && block->IsOpen();}
+  TString GetFileName() {return fileName;}
+
+  bool Add(ULong64_t timeStamp, UInt_t energy, int ch, unsigned short flags){ /// false when the hit is dropped
+    if( current == NULL && !NextBlock() ) { droppedHit ++; return false; }
+    RawHit &hit = currentHit[nRecord];
+    hit.timeStamp = timeStamp;
+    hit.energy    = energy;
+    hit.channel   = (uint16_t) ch;
+    hit.flags     = flags;
+    nRecord ++;
+    if( nRecord == recordPerBlock ) Queue();
+    return true;
+  }
+
+  void Flush();  /// queue the partial block, e.g. at each update or when the acquisition stops
+  void Drain();  /// wait until every queued block is on disk
+  void Close();  /// flush, drain, stop the thread and close the file
+
+  double GetFileSizeMB();
+  void   PrintStatistic();
+
+private:
+
+  TString fileName;
+  BlockWriter * block;
+  uint32_t recordPerBlock;
+  uint32_t sequence;
+
+  char * current;                /// owned by the read-out thread, NULL = none
+  RawHit * currentHit;
+  uint32_t nRecord;
+
+  ULong64_t queuedHit;
+  ULong64_t droppedHit;          /// read-out thread only
+
+  bool NextBlock();
+  void Queue();
+};
+
+RawHitWriter::RawHitWriter(TString fileName, RawHitFileHeader header, int blockSizeMB, int nBuffer, bool directIO, double preallocMB){
+
+  this->fileName = fileName;
+
+  if( blockSizeMB < 1 ) blockSizeMB = 1;
+  if( nBuffer < 1 ) nBuffer = RawHitMemoryMB / blockSizeMB; /// 0 = the memory budget
+  int nPool = nBuffer < RawHitPoolBlock ? nBuffer : RawHitPoolBlock;
+  size_t blockSize = (size_t) blockSizeMB << 20;
+  recordPerBlock = (blockSize - sizeof(RawHitBlockHeader)) / sizeof(RawHit);
+  sequence = 0;
+  current = NULL;
+  currentHit = NULL;
+  nRecord = 0;
+  queuedHit = 0;
+  droppedHit = 0;
+
+  block = new BlockWriter(fileName, blockSize, nPool, nBuffer, directIO, preallocMB);
+  if( !block->IsOpen() ) return;
+
+  /// the file header takes a full RawHitAlign, so that every block starts aligned
+  header.startTime = (uint64_t) time(NULL);
+  if( !block->WriteHeader(&header, sizeof(RawHitFileHeader)) ){
+    printf("cannot write the header of raw hit file %s\n", fileName.Data());
+    block->Close();
+    return;
+  }
+
+  printf("====== Raw hit writer started : %s, block %d MB, %d buffers ( up to %d )%s\n", fileName.Data(), blockSizeMB, nPool, nBuffer, block->IsDirectIO() ? ", O_DIRECT" : "");
+}
+
+RawHitWriter::~RawHitWriter(){
+  Close();
+  delete block;
+}
+
+bool RawHitWriter::NextBlock(){
+  current = block->GetBuffer();
+  if( current == NULL ) return false; /// the writer is behind
+  currentHit = (RawHit *) (current + sizeof(RawHitBlockHeader));
+  nRecord = 0;
+  return true;
+}
+
+void RawHitWriter::Queue(){
+  if( current == NULL ) return;
+  if( nRecord == 0 ) return;
+
+  size_t used = sizeof(RawHitBlockHeader) + nRecord * sizeof(RawHit);
+  RawHitBlockHeader * head = (RawHitBlockHeader *) current;
+  head->magic = RawBlockMagic;
+  head->nRecord = nRecord;
+  head->blockBytes = (used + RawHitAlign - 1) / RawHitAlign * RawHitAlign;
+  head->sequence = sequence ++;
+
+  block->Submit(current, used);
+  queuedHit += nRecord;
+  current = NULL;
+}
+
+void RawHitWriter::Flush(){
+  if( !IsOpen() ) return;
+  Queue();
+}
+
+void RawHitWriter::Drain(){
+  if( !IsOpen() ) return;
+  block->Drain();
+}
+
+void RawHitWriter::Close(){
+  if( !IsOpen() ) return;
+  Flush();
+  if( current != NULL ) { block->Release(current); current = NULL; } /// an empty block
+  block->Close();
+  printf("====== Raw hit writer stopped : %s, %llu hits, %.1f MB", fileName.Data(), queuedHit, block->GetFileSizeMB());
+  if( droppedHit > 0 ) printf(", %llu hits dropped", droppedHit);
+  printf("\n");
+}
+
+double RawHitWriter::GetFileSizeMB(){
+  return block->GetFileSizeMB();
+}
+
+void RawHitWriter::PrintStatistic(){
+  block->PrintStatistic("Raw hits");
+  printf("           %12llu hits | dropped %llu\n", queuedHit, droppedHit);
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef REPLAYCACHE
+#define REPLAYCACHE
+
+#include <stdio.h>
+#include "TString.h"
+#include "TFile.h"
+#include "TDirectory.h"
+#include "TNamed.h"
+#include "TH1.h"
+#include "TMultiGraph.h"
+#include "TVectorD.h"
+#include "TSystem.h"
+#include "TMD5.h"
+
+#include "GenericPlane.h"
+
+/// The histograms of a replay of BoxScoreReader, saved next to the root file as base.location.replay.root,
+/// with two keys,
+///   data key  size and modification time of the root file, the plane and the selection given by the caller
+///             ( entry range, time range, serial or parallel read )
+///   cut key   md5 of the cut file, "none" without cut
+/// Load() gives back every registered histogram, the rate graph and the cut counts when both keys match,
+/// only the histograms that do not depend on the cuts when only the cut key differs, the caller then
+/// re-fills the cut histograms ( GenericPlane::SetCutOnly ) and Save() the result.
+
+class ReplayCache{
+public:
+
+  ReplayCache(TString rootFile, TString location, TString cutFile, TString selection);
+  ~ReplayCache(){};
+
+  enum { Miss = 0, CutChanged = 1, Hit = 2 };
+
+  int  Load(GenericPlane * gp);  /// Miss, CutChanged or Hit
+  bool Save(GenericPlane * gp);
+
+  TString GetFileName()  {return fileName;}
+  TString GetDataKey()   {return dataKey;}
+  TString GetCutKey()    {return cutKey;}
+
+private:
+
+  TString fileName;
+  TString dataKey;
+  TString cutKey;
+};
+
+ReplayCache::ReplayCache(TString rootFile, TString location, TString cutFile, TString selection){
+
+  fileName = rootFile;
+  if( fileName.EndsWith(".root") ) fileName.Remove(fileName.Length() - 5);
+  fileName += "." + location + ".replay.root";
+
+  Long_t id, flags, modTime = 0;
+  Long64_t size = 0;
+  gSystem->GetPathInfo(rootFile, &id, &size, &flags, &modTime);
+
+  dataKey.Form("%lld:%ld:%s:%s", size, modTime, location.Data(), selection.Data());
+
+  cutKey = "none";
+  if( cutFile != "" ){
+    TMD5 * md5 = TMD5::FileChecksum(cutFile);
+    cutKey = md5 == NULL ? "missing" : md5->AsString();
+    delete md5;
+  }
+}
+
+int ReplayCache::Load(GenericPlane * gp){
+
+  if( gSystem->AccessPathName(fileName) ) return Miss; /// no such file
+
+  TFile * file = new TFile(fileName, "READ");
+  if( file->IsZombie() ){
+    delete file;
+    return Miss;
+  }
+
+  TNamed * savedData = (TNamed *) file->Get("dataKey");
+  TNamed * savedCut  = (TNamed *) file->Get("cutKey");
+  if( savedData == NULL || savedCut == NULL || dataKey != savedData->GetTitle() ){
+    file->Close();
+    delete file;
+    return Miss;
+  }
+  bool isSameCut = cutKey == savedCut->GetTitle();
+
+  vector<TObject *> list = gp->GetHistogramList();
+  for( int i = 0; i < (int) list.size(); i++){
+    if( list[i]->InheritsFrom("TH1") ){
+      if( !isSameCut && gp->IsCutHistogram(i) ) continue;
+      TH1 * h = (TH1 *) file->Get(list[i]->GetName());
+      if( h == NULL ) continue;
+      ((TH1 *) list[i])->Reset();
+      ((TH1 *) list[i])->Add(h);
+    }else if( isSameCut && list[i]->InheritsFrom("TMultiGraph") ){
+      TMultiGraph * graph = (TMultiGraph *) file->Get(list[i]->GetName());
+      if( graph != NULL ) gp->RestoreRateGraph(graph);
+    }
+  }
+
+  if( isSameCut ){
+    TVectorD * counts = (TVectorD *) file->Get("countOfCut");
+    if( counts != NULL ) for( int i = 0; i < counts->GetNoElements(); i++) gp->SetCountOfCut(i, (int) (*counts)[i]);
+  }
+
+  file->Close();
+  delete file;
+  return isSameCut ? Hit : CutChanged;
+}
+
+bool ReplayCache::Save(GenericPlane * gp){
+
+  TDirectory::TContext context; /// keep gDirectory for the histograms of the plane
+  TFile * file = new TFile(fileName, "RECREATE");
+  if( file->IsZombie() ){
+    printf("cannot write the replay cache %s\n", fileName.Data());
+    delete file;
+    return false;
+  }
+
+  TNamed("dataKey", dataKey.Data()).Write();
+  TNamed("cutKey", cutKey.Data()).Write();
+
+  vector<TObject *> list = gp->GetHistogramList();
+  for( int i = 0; i < (int) list.size(); i++) list[i]->Write(list[i]->GetName(), TObject::kOverwrite);
+
+  int nCut = gp->GetNumCut();
+  if( nCut > 0 ){
+    TVectorD counts(nCut);
+    for( int i = 0; i < nCut; i++) counts[i] = gp->GetCountOfCut(i);
+    counts.Write("countOfCut");
+  }
+
+  file->Close();
+  delete file;
+  return true;
+}
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef SETTINGJOURNAL
+#define SETTINGJOURNAL
+
+#include <stdio.h>
+#include <string.h>
+#include <ctime>
+#include <vector>
+#include "TString.h"
+#include "TFile.h"
+#include "TTree.h"
+
+/// The journal of the settings changed during a run, saved as the "journal" tree next to the "tree".
+/// One row per change,
+///   time        unix time of the change
+///   event       events handed to the file before the change, run-wide, the first event with the new
+///               setting is entry "event" of the tree ( of the whole run with rollover, see base_index.txt )
+///   timeStamp   time stamp of the last event before the change [ch]
+///   ch          channel, -1 for the board or the program
+///   key         threshold, dynamicRange, riseTime, flatTop, decay, baseLineEnd, recordLength, probe,
+///               coincidentWindow, channelFile, acqMode
+///   oldValue, newValue, text ( a file name, a mode )
+/// The setting epochs are the event ranges between the rows, GetEpoch() / GetEpochRange().
+
+using namespace std;
+
+class SettingJournal{
+public:
+
+  SettingJournal(){};
+  ~SettingJournal(){};
+
+  ///===== writer
+  void Add(TString key, int channel, double oldValue, double newValue, ULong64_t event, ULong64_t timeStamp, TString text = "");
+  TTree * MakeTree();   /// "journal" in the current directory, caller deletes
+
+  ///===== reader
+  bool Load(TFile * file);  /// false when the file has no journal
+  int  GetN()                       {return rows.size();}
+  TString   GetKey(int i)           {return rows[i].key;}
+  int       GetChannel(int i)       {return rows[i].channel;}
+  double    GetOldValue(int i)      {return rows[i].oldValue;}
+  double    GetNewValue(int i)      {return rows[i].newValue;}
+  ULong64_t GetEvent(int i)         {return rows[i].event;}
+  int  GetEpoch(ULong64_t event);   /// number of changes before the event, 0 = the settings at the start
+  bool GetEpochRange(int epoch, ULong64_t &first, ULong64_t &last); /// run-wide events, false for an empty or unknown epoch, last = -1 ( all ones ) for the open one
+  void Print();
+
+private:
+
+  struct Row{
+    time_t    time;
+    ULong64_t event;
+    ULong64_t timeStamp;
+    int       channel;
+    TString   key;
+    double    oldValue;
+    double    newValue;
+    TString   text;
+  };
+
+  vector<Row> rows;
+};
+
+void SettingJournal::Add(TString key, int channel, double oldValue, double newValue, ULong64_t event, ULong64_t timeStamp, TString text){
+  Row row;
+  row.time = time(NULL);
+  row.event = event;
+  row.timeStamp = timeStamp;
+  row.channel = channel;
+  row.key = key;
+  row.oldValue = oldValue;
+  row.newValue = newValue;
+  row.text = text;
+  rows.push_back(row);
+  printf("====== journal : %s", key.Data());
+  if( channel >= 0 ) printf(" ch-%d", channel);
+  if( text != "" ) {
+    printf(" %s", text.Data());
+  }else{
+    printf(" %g -> %g", oldValue, newValue);
+  }
+  printf(", from event %llu\n", event);
+}
+
+TTree * SettingJournal::MakeTree(){
+
+  TTree * tree = new TTree("journal", "settings changed during the run");
+
+  Long64_t t;
+  ULong64_t event, timeStamp;
+  int ch;
+  char key[32], text[256];
+  double oldValue, newValue;
+
+  tree->Branch("time", &t, "time/L");
+  tree->Branch("event", &event, "event/l");
+  tree->Branch("timeStamp", &timeStamp, "timeStamp/l");
+  tree->Branch("ch", &ch, "ch/I");
+  tree->Branch("key", key, "key/C");
+  tree->Branch("oldValue", &oldValue, "oldValue/D");
+  tree->Branch("newValue", &newValue, "newValue/D");
+  tree->Branch("text", text, "text/C");
+
+  for( int i = 0; i < (int) rows.size(); i++){
+    t = rows[i].time;
+    event = rows[i].event;
+    timeStamp = rows[i].timeStamp;
+    ch = rows[i].channel;
+    snprintf(key, sizeof(key), "%s", rows[i].key.Data());
+    snprintf(text, sizeof(text), "%s", rows[i].text.Data());
+    oldValue = rows[i].oldValue;
+    newValue = rows[i].newValue;
+    tree->Fill();
+  }
+
+  tree->ResetBranchAddresses();
+  return tree;
+}
+
+bool SettingJournal::Load(TFile * file){
+  rows.clear();
+  TTree * tree = (TTree *) file->Get("journal");
+  if( tree == NULL ) return false;
+
+  Long64_t t;
+  char key[32], text[256];
+  Row row;
+  tree->SetBranchAddress("time", &t);
+  tree->SetBranchAddress("event", &row.event);
+  tree->SetBranchAddress("timeStamp", &row.timeStamp);
+  tree->SetBranchAddress("ch", &row.channel);
+  tree->SetBranchAddress("key", key);
+  tree->SetBranchAddress("oldValue", &row.oldValue);
+  tree->SetBranchAddress("newValue", &row.newValue);
+  tree->SetBranchAddress("text", text);
+
+  for( Long64_t i = 0; i < tree->GetEntries(); i++){
+    tree->GetEntry(i);
+    row.time = t;
+    row.key = key;
+    row.text = text;
+    rows.push_back(row);
+  }
+  tree->ResetBranchAddresses();
+  return true;
+}
+
+int SettingJournal::GetEpoch(ULong64_t event){
+  int epoch = 0;
+  for( int i = 0; i < (int) rows.size(); i++){
+    if( rows[i].event <= event ) epoch = i + 1;
+  }
+  return epoch;
+}
+
+bool SettingJournal::GetEpochRange(int epoch, ULong64_t &first, ULong64_t &last){
+  if( epoch < 0 || epoch > (int) rows.size() ) return false;
+  first = (epoch <= 0 || rows.empty()) ? 0 : rows[epoch - 1].event;
+  if( epoch >= (int) rows.size() ) {
+    last = (ULong64_t) -1;
+    return true;
+  }
+  if( rows[epoch].event <= first ) return false; /// two changes without event in between
+  last = rows[epoch].event - 1;
+  return true;
+}
+
+void SettingJournal::Print(){
+  printf("======== settings journal, %d changes\n", (int) rows.size());
+  for( int i = 0; i < (int) rows.size(); i++){
+    printf(" %3d | event %10llu | %-16s | ch %2d | %10g -> %-10g %s\n", i + 1, rows[i].event, rows[i].key.Data(),
+             rows[i].channel, rows[i].oldValue, rows[i].newValue, rows[i].text.Data());
+  }
+}
+
+#endif
@@ -0,0 +1,288 @@
+#ifndef TIMEINDEX
+#define TIMEINDEX
+
+#include <stdio.h>
+#include <vector>
+#include "TString.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TList.h"
+#include "TObjArray.h"
+#include "TObjString.h"
+#include "TCutG.h"
+#include "TParameter.h"
+
+/// A coarse time index of the "tree", saved as the "timeIndex" tree in the same file.
+/// One row per time bucket ( 1 sec by default ) of the event time, the earliest hit of the event,
+///   tStart      bucket start [ch]
+///   tFirst/tLast  earliest and latest event time in the bucket [ch]
+///   firstEntry/lastEntry  entry range of the "tree", inclusive
+///   nEvent, cutCount[nCut]  number of events, and of events inside each cut ( dE-E, as GenericPlane )
+/// A bucket can have several rows when the events are not in time order, the reader merges them.
+
+using namespace std;
+
+class TimeIndex{
+public:
+
+  TimeIndex();
+  ~TimeIndex();
+
+  ///===== writer
+  void SetBucket(double sec, int ch2ns);
+  void SetCuts(TObjArray * cutList, int chdE, int chE);   /// a copy is kept
+  void Add(Long64_t entry, UInt_t * energy, ULong64_t * timeStamp, int nChannel); /// channel indexed
+  void Clear();                                           /// a new file
+  TTree * MakeTree();                                     /// "timeIndex" in the current directory, caller deletes
+
+  ///===== reader
+  bool Load(TFile * file);                                /// false when the file has no index
+  bool GetEntryRange(double startSec, double stopSec, Long64_t &first, Long64_t &last); /// sec from GetFirstTime()
+  ULong64_t GetEventCount(double startSec, double stopSec);
+  ULong64_t GetCutCount(int cut, double startSec, double stopSec);
+
+  ULong64_t GetFirstTime();                               /// ch, earliest event
+  ULong64_t GetLastTime();                                /// ch, latest event
+  double    GetLengthSec();
+  double    GetBucketSec()                                {return bucketSec;}
+  int       GetCh2ns()                                    {return ch2ns;}
+  int       GetNCut()                                     {return cutNames.size();}
+  TString   GetCutName(int i)                             {return cutNames[i];}
+  int       GetNRow()                                     {return rows.size();}
+
+private:
+
+  struct Row{
+    ULong64_t tStart;
+    ULong64_t tFirst;
+    ULong64_t tLast;
+    Long64_t  firstEntry;
+    Long64_t  lastEntry;
+    int       nEvent;
+    vector<int> cutCount;
+  };
+
+  double bucketSec;
+  int ch2ns;
+  ULong64_t bucketCh;
+
+  vector<Row> rows;
+  Row current;
+  bool hasCurrent;
+
+  TObjArray * cuts;
+  int chdE, chE;
+  vector<TString> cutNames;
+
+  bool InRange(const Row &row, double startSec, double stopSec);
+};
+
+TimeIndex::TimeIndex(){
+  cuts = NULL;
+  chdE = 0;
+  chE = 0;
+  hasCurrent = false;
+  SetBucket(1., 2);
+}
+
+TimeIndex::~TimeIndex(){
+  if( cuts != NULL ) cuts->Delete();
+  delete cuts;
+}
+
+void TimeIndex::SetBucket(double sec, int ch2ns){
+  bucketSec = sec > 0 ? sec : 1.;
+  this->ch2ns = ch2ns > 0 ? ch2ns : 2;
+  bucketCh = (ULong64_t) (bucketSec * 1e9 / this->ch2ns);
+  if( bucketCh == 0 ) bucketCh = 1;
+}
+
+void TimeIndex::SetCuts(TObjArray * cutList, int chdE, int chE){
+  if( hasCurrent ) { rows.push_back(current); hasCurrent = false; } /// the counts change meaning
+
+  if( cuts != NULL ) cuts->Delete();
+  delete cuts;
+  cuts = NULL;
+  cutNames.clear();
+
+  this->chdE = chdE;
+  this->chE = chE;
+  if( cutList == NULL ) return;
+
+  cuts = new TObjArray();
+  for( int i = 0; i <= cutList->GetLast(); i++){
+    TCutG * cut = (TCutG *) cutList->At(i);
+    cuts->Add(cut->Clone());
+    cutNames.push_back(cut->GetName());
+  }
+}
+
+void TimeIndex::Clear(){
+  rows.clear();
+  hasCurrent = false;
+}
+
+void TimeIndex::Add(Long64_t entry, UInt_t * energy, ULong64_t * timeStamp, int nChannel){
+
+  ULong64_t t = 0;
+  for( int i = 0; i < nChannel; i++){
+    if( timeStamp[i] > 0 && (t == 0 || timeStamp[i] < t) ) t = timeStamp[i];
+  }
+  ULong64_t tStart = t / bucketCh * bucketCh;
+
+  if( !hasCurrent || current.tStart != tStart ){
+    if( hasCurrent ) rows.push_back(current);
+    current.tStart = tStart;
+    current.tFirst = t;
+    current.tLast = t;
+    current.firstEntry = entry;
+    current.lastEntry = entry;
+    current.nEvent = 0;
+    current.cutCount.assign(cutNames.size(), 0);
+    hasCurrent = true;
+  }
+
+  if( t < current.tFirst ) current.tFirst = t;
+  if( t > current.tLast ) current.tLast = t;
+  if( entry < current.firstEntry ) current.firstEntry = entry;
+  if( entry > current.lastEntry ) current.lastEntry = entry;
+  current.nEvent ++;
+
+  if( cuts != NULL && chE < nChannel && chdE < nChannel ){
+    for( int i = 0; i <= cuts->GetLast(); i++){
+      if( ((TCutG *) cuts->At(i))->IsInside(energy[chE], energy[chdE]) ) current.cutCount[i] ++;
+    }
+  }
+}
+
+TTree * TimeIndex::MakeTree(){
+
+  TTree * tree = new TTree("timeIndex", "time index of tree, one row per time bucket");
+
+  int maxCut = 1;
+  for( int i = 0; i < (int) rows.size(); i++) if( (int) rows[i].cutCount.size() > maxCut ) maxCut = rows[i].cutCount.size();
+  if( hasCurrent && (int) current.cutCount.size() > maxCut ) maxCut = current.cutCount.size();
+
+  Row row;
+  int nCut;
+  int * cutCount = new int[maxCut];
+
+  tree->Branch("tStart", &row.tStart, "tStart/l");
+  tree->Branch("tFirst", &row.tFirst, "tFirst/l");
+  tree->Branch("tLast", &row.tLast, "tLast/l");
+  tree->Branch("firstEntry", &row.firstEntry, "firstEntry/L");
+  tree->Branch("lastEntry", &row.lastEntry, "lastEntry/L");
+  tree->Branch("nEvent", &row.nEvent, "nEvent/I");
+  tree->Branch("nCut", &nCut, "nCut/I");
+  tree->Branch("cutCount", cutCount, "cutCount[nCut]/I");
+
+  int n = rows.size() + (hasCurrent ? 1 : 0);
+  for( int i = 0; i < n; i++){
+    row = i < (int) rows.size() ? rows[i] : current;
+    nCut = row.cutCount.size();
+    for( int k = 0; k < nCut; k++) cutCount[k] = row.cutCount[k];
+    tree->Fill();
+  }
+
+  tree->GetUserInfo()->Add(new TParameter<double>("bucketSec", bucketSec));
+  tree->GetUserInfo()->Add(new TParameter<int>("ch2ns", ch2ns));
+  for( int i = 0; i < (int) cutNames.size(); i++) tree->GetUserInfo()->Add(new TObjString(cutNames[i]));
+
+  tree->ResetBranchAddresses();
+  delete [] cutCount;
+  return tree;
+}
+
+bool TimeIndex::Load(TFile * file){
+  Clear();
+  cutNames.clear();
+
+  TTree * tree = (TTree *) file->Get("timeIndex");
+  if( tree == NULL ) return false;
+
+  TParameter<double> * parBucket = (TParameter<double> *) tree->GetUserInfo()->FindObject("bucketSec");
+  TParameter<int> * parCh2ns = (TParameter<int> *) tree->GetUserInfo()->FindObject("ch2ns");
+  SetBucket(parBucket == NULL ? 1. : parBucket->GetVal(), parCh2ns == NULL ? 2 : parCh2ns->GetVal());
+  TIter next(tree->GetUserInfo());
+  while( TObject * obj = next() ){
+    if( obj->InheritsFrom("TObjString") ) cutNames.push_back(((TObjString *) obj)->GetString());
+  }
+
+  Row row;
+  int nCut = 0;
+  int maxCut = (int) tree->GetMaximum("nCut"); /// the largest nCut of the rows
+  if( (int) cutNames.size() > maxCut ) maxCut = cutNames.size();
+  vector<int> cutCount(maxCut > 0 ? maxCut : 1);
+  tree->SetBranchAddress("tStart", &row.tStart);
+  tree->SetBranchAddress("tFirst", &row.tFirst);
+  tree->SetBranchAddress("tLast", &row.tLast);
+  tree->SetBranchAddress("firstEntry", &row.firstEntry);
+  tree->SetBranchAddress("lastEntry", &row.lastEntry);
+  tree->SetBranchAddress("nEvent", &row.nEvent);
+  tree->SetBranchAddress("nCut", &nCut);
+  tree->SetBranchAddress("cutCount", cutCount.data());
+
+  for( Long64_t i = 0; i < tree->GetEntries(); i++){
+    tree->GetEntry(i);
+    row.cutCount.assign(cutCount.begin(), cutCount.begin() + nCut);
+    rows.push_back(row);
+  }
+  tree->ResetBranchAddresses();
+
+  return !rows.empty();
+}
+
+ULong64_t TimeIndex::GetFirstTime(){
+  ULong64_t t = 0;
+  for( int i = 0; i < (int) rows.size(); i++){
+    if( rows[i].tFirst > 0 && (t == 0 || rows[i].tFirst < t) ) t = rows[i].tFirst;
+  }
+  return t;
+}
+
+ULong64_t TimeIndex::GetLastTime(){
+  ULong64_t t = 0;
+  for( int i = 0; i < (int) rows.size(); i++) if( rows[i].tLast > t ) t = rows[i].tLast;
+  return t;
+}
+
+double TimeIndex::GetLengthSec(){
+  ULong64_t t0 = GetFirstTime(), t1 = GetLastTime();
+  return t1 > t0 ? (t1 - t0) * ch2ns * 1e-9 : 0;
+}
+
+bool TimeIndex::InRange(const Row &row, double startSec, double stopSec){
+  ULong64_t t0 = GetFirstTime();
+  double first = row.tFirst >= t0 ? (row.tFirst - t0) * ch2ns * 1e-9 : 0;
+  double last  = row.tLast  >= t0 ? (row.tLast  - t0) * ch2ns * 1e-9 : 0;
+  return last >= startSec && first <= stopSec;
+}
+
+bool TimeIndex::GetEntryRange(double startSec, double stopSec, Long64_t &first, Long64_t &last){
+  first = -1;
+  last = -1;
+  for( int i = 0; i < (int) rows.size(); i++){
+    if( !InRange(rows[i], startSec, stopSec) ) continue;
+    if( first < 0 || rows[i].firstEntry < first ) first = rows[i].firstEntry;
+    if( rows[i].lastEntry > last ) last = rows[i].lastEntry;
+  }
+  return first >= 0;
+}
+
+ULong64_t TimeIndex::GetEventCount(double startSec, double stopSec){
+  ULong64_t count = 0;
+  for( int i = 0; i < (int) rows.size(); i++){
+    if( InRange(rows[i], startSec, stopSec) ) count += rows[i].nEvent;
+  }
+  return count;
+}
+
+ULong64_t TimeIndex::GetCutCount(int cut, double startSec, double stopSec){
+  ULong64_t count = 0;
+  for( int i = 0; i < (int) rows.size(); i++){
+    if( cut < (int) rows[i].cutCount.size() && InRange(rows[i], startSec, stopSec) ) count += rows[i].cutCount[cut];
+  }
+  return count;
+}
+
+#endif
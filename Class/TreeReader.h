@@ -0,0 +1,354 @@
+#ifndef TREEREADER
+#define TREEREADER
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "TString.h"
+#include "TTree.h"
+#include "TBranch.h"
+#include "TLeaf.h"
+#include "TList.h"
+#include "TParameter.h"
+
+/// Read the "tree" of BoxScore in either schema, and give the event back
+/// as arrays indexed by channel, as the digitizer builds it.
+///
+///   fixed   : ch[NChannel], e[NChannel], t[NChannel], tf[NChannel], (wave)
+///   compact : nHit, ch[nHit], e[nHit], t[nHit], tf[nHit], (wave)
+///             hits are time ordered ( channel ordered when with waves ),
+///             with "deltaT" t[k>0] is t[k] - t[0], modulo 2^64
+///
+/// The schema is in the UserInfo of the tree, a tree without it is the fixed schema.
+///
+/// ReadBlock() reads a block of entries, at most one cluster, column by column, each branch straight
+/// through its baskets, into nEntry x GetSlot() arrays, for replaying a run without the per-entry
+/// overhead of TTree::GetEntry().
+///
+/// The events are built and written nearly in time order, FindEntry() bisects the entries on the time
+/// of the event, GetTimeSpan() reads only the two ends, neither needs the time index nor a full read.
+
+using namespace std;
+
+class TreeReader{
+public:
+
+  TreeReader(TTree * tree);
+  ~TreeReader();
+
+  static int GetUserInfo(TTree * tree, TString name, int defaultValue);
+  static TString EnergyExpression(TTree * tree, int ch); /// for TTree::Draw, e of a channel, 0 if no hit
+
+  bool     IsCompact()                {return isCompact;}
+  bool     IsDeltaTime()              {return isDeltaTime;}
+  int      GetNChannel()              {return nChannel;}
+  Long64_t GetEntries()               {return tree->GetEntries();}
+
+  int      GetEntry(Long64_t entry);  /// return number of hits
+
+  int        GetNHit()                {return nHit;}
+  UInt_t *   GetEnergy()              {return energy;}
+  ULong64_t* GetTimeStamp()           {return timeStamp;}
+  UShort_t * GetFineTime()            {return fineTime;}
+  ULong64_t  GetFirstTimeStamp()      {return firstTimeStamp;} /// earliest hit of the event, 0 if no hit
+
+  ///===== time, by reading a few entries
+  ULong64_t  GetEntryTime(Long64_t entry, int direction = 1); /// the entry, or the nearest one with a hit in the direction, 0 if none
+  Long64_t   FindEntry(ULong64_t time, Long64_t first, Long64_t last); /// first entry of [first, last) at or after time, last if none
+  bool       GetTimeSpan(ULong64_t &tFirst, ULong64_t &tLast); /// of the first and the last entry
+
+  ///===== block of entries
+  int        ReadBlock(Long64_t first, Long64_t last); /// [first, last), stops at the end of the cluster, returns the entries read
+  int        GetSlot()                {return nSlot;}  /// row length of the block arrays
+  UInt_t *   GetBlockEnergy()         {return blockE;}
+  ULong64_t* GetBlockTimeStamp()      {return blockT;}
+  UShort_t * GetBlockFineTime()       {return blockTf;}
+  void       SetBlockCapacity(int n)  {blockCapacity = n > 0 ? n : 1;}
+
+private:
+
+  TTree * tree;
+  bool isCompact;
+  bool isDeltaTime;
+  int nChannel;
+  int nSlot;      /// size of the arrays, at least 16, so that any plane can index them
+
+  ///===== channel indexed
+  UInt_t *    energy;
+  ULong64_t * timeStamp;
+  UShort_t *  fineTime;
+  int nHit;
+  ULong64_t firstTimeStamp;
+
+  ///===== compact branches
+  int        hitN;
+  UChar_t *  hitCh;
+  UInt_t *   hitE;
+  ULong64_t* hitT;
+  UShort_t * hitTf;
+
+  ///===== block
+  TBranch *  brN;
+  TBranch *  brCh;
+  TBranch *  brE;
+  TBranch *  brT;
+  TBranch *  brTf;
+  int        blockCapacity;  /// entries, a larger cluster is read in parts
+  int        blockSize;      /// allocated rows
+  UInt_t *   blockE;
+  ULong64_t* blockT;
+  UShort_t * blockTf;
+  vector<int>       blockN;  /// compact, hits of the entry
+  vector<UChar_t>   flatCh;  /// compact, the hits of the block
+  vector<UInt_t>    flatE;
+  vector<ULong64_t> flatT;
+  vector<UShort_t>  flatTf;
+
+  void ReserveBlock(int n);
+};
+
+TreeReader::TreeReader(TTree * tree){
+
+  this->tree = tree;
+
+  isCompact   = GetUserInfo(tree, "compact", 0) == 1;
+  isDeltaTime = GetUserInfo(tree, "deltaT", 0) == 1;
+  nChannel    = GetUserInfo(tree, "nChannel", 0);
+  if( nChannel == 0 ){ /// fixed schema, the array length of the energy leaf
+    TBranch * branch = tree->GetBranch("e");
+    TLeaf * leaf = branch == NULL ? NULL : (TLeaf *) branch->GetListOfLeaves()->At(0);
+    nChannel = ( leaf != NULL && !isCompact ) ? leaf->GetLenStatic() : 16;
+  }
+  nSlot = nChannel > 16 ? nChannel : 16;
+
+  energy    = new UInt_t[nSlot];
+  timeStamp = new ULong64_t[nSlot];
+  fineTime  = new UShort_t[nSlot];
+  for( int i = 0; i < nSlot; i++){
+    energy[i] = 0;
+    timeStamp[i] = 0;
+    fineTime[i] = 0;
+  }
+
+  hitCh = NULL;
+  hitE  = NULL;
+  hitT  = NULL;
+  hitTf = NULL;
+
+  tree->SetBranchStatus("*", 0);
+  tree->SetBranchStatus("e", 1);
+  tree->SetBranchStatus("t", 1);
+  if( tree->GetBranch("tf") != NULL ) tree->SetBranchStatus("tf", 1);
+
+  if( isCompact ){
+    hitCh = new UChar_t[nChannel]();
+    hitE  = new UInt_t[nChannel]();
+    hitT  = new ULong64_t[nChannel]();
+    hitTf = new UShort_t[nChannel]();
+    tree->SetBranchStatus("nHit", 1);
+    tree->SetBranchStatus("ch", 1);
+    tree->SetBranchAddress("nHit", &hitN);
+    tree->SetBranchAddress("ch", hitCh);
+    tree->SetBranchAddress("e", hitE);
+    tree->SetBranchAddress("t", hitT);
+    if( tree->GetBranch("tf") != NULL ) tree->SetBranchAddress("tf", hitTf);
+  }else{
+    tree->SetBranchAddress("e", energy);
+    tree->SetBranchAddress("t", timeStamp);
+    if( tree->GetBranch("tf") != NULL ) tree->SetBranchAddress("tf", fineTime);
+  }
+
+  brN  = tree->GetBranch("nHit");
+  brCh = tree->GetBranch("ch");
+  brE  = tree->GetBranch("e");
+  brT  = tree->GetBranch("t");
+  brTf = tree->GetBranch("tf");
+  blockCapacity = 65536;
+  blockSize = 0;
+  blockE  = NULL;
+  blockT  = NULL;
+  blockTf = NULL;
+
+  printf(" tree schema : %s%s, %d channels\n", isCompact ? "compact (nHit)" : "fixed", isDeltaTime ? ", delta time stamp" : "", nChannel);
+}
+
+TreeReader::~TreeReader(){
+  tree->ResetBranchAddresses();
+  delete [] energy;
+  delete [] timeStamp;
+  delete [] fineTime;
+  delete [] hitCh;
+  delete [] hitE;
+  delete [] hitT;
+  delete [] hitTf;
+  delete [] blockE;
+  delete [] blockT;
+  delete [] blockTf;
+}
+
+int TreeReader::GetUserInfo(TTree * tree, TString name, int defaultValue){
+  TParameter<int> * par = (TParameter<int> *) tree->GetUserInfo()->FindObject(name);
+  if( par == NULL ) return defaultValue;
+  return par->GetVal();
+}
+
+TString TreeReader::EnergyExpression(TTree * tree, int ch){
+  TString expression;
+  if( GetUserInfo(tree, "compact", 0) == 1 ){
+    expression.Form("Sum$(e*(ch==%d))", ch);
+  }else{
+    expression.Form("e[%d]", ch);
+  }
+  return expression;
+}
+
+int TreeReader::GetEntry(Long64_t entry){
+
+  tree->GetEntry(entry);
+
+  firstTimeStamp = 0;
+
+  if( !isCompact ){
+    nHit = 0;
+    for( int i = 0; i < nChannel; i++){
+      if( timeStamp[i] == 0 ) continue;
+      nHit ++;
+      if( firstTimeStamp == 0 || timeStamp[i] < firstTimeStamp ) firstTimeStamp = timeStamp[i];
+    }
+    return nHit;
+  }
+
+  for( int i = 0; i < nChannel; i++){
+    energy[i] = 0;
+    timeStamp[i] = 0;
+    fineTime[i] = 0;
+  }
+
+  nHit = hitN;
+  for( int k = 0; k < nHit; k++){
+    int ch = hitCh[k];
+    if( ch >= nSlot ) continue;
+    energy[ch]    = hitE[k];
+    timeStamp[ch] = ( isDeltaTime && k > 0 ) ? hitT[0] + hitT[k] : hitT[k];
+    fineTime[ch]  = hitTf[k];
+    if( timeStamp[ch] > 0 && (firstTimeStamp == 0 || timeStamp[ch] < firstTimeStamp) ) firstTimeStamp = timeStamp[ch];
+  }
+
+  return nHit;
+}
+
+ULong64_t TreeReader::GetEntryTime(Long64_t entry, int direction){
+  Long64_t nEntry = tree->GetEntries();
+  for( int i = 0; i < 1000 && entry >= 0 && entry < nEntry; i++, entry += direction){
+    GetEntry(entry);
+    if( firstTimeStamp > 0 ) return firstTimeStamp;
+  }
+  return 0;
+}
+
+Long64_t TreeReader::FindEntry(ULong64_t time, Long64_t first, Long64_t last){
+  Long64_t cacheSize = tree->GetCacheSize();
+  tree->SetCacheSize(0); /// a cache would read a whole cluster around every probe
+
+  Long64_t lo = first, hi = last;
+  while( lo < hi ){
+    Long64_t mid = lo + (hi - lo) / 2;
+    ULong64_t t = GetEntryTime(mid, 1);
+    if( t == 0 || t >= time ) {
+      hi = mid;
+    }else{
+      lo = mid + 1;
+    }
+  }
+
+  tree->SetCacheSize(cacheSize);
+  return lo;
+}
+
+bool TreeReader::GetTimeSpan(ULong64_t &tFirst, ULong64_t &tLast){
+  Long64_t cacheSize = tree->GetCacheSize();
+  tree->SetCacheSize(0);
+  tFirst = GetEntryTime(0, 1);
+  tLast  = GetEntryTime(tree->GetEntries() - 1, -1);
+  tree->SetCacheSize(cacheSize);
+  return tFirst > 0 && tLast >= tFirst;
+}
+
+void TreeReader::ReserveBlock(int n){
+  if( n <= blockSize ) return;
+  delete [] blockE;
+  delete [] blockT;
+  delete [] blockTf;
+  blockE  = new UInt_t[(size_t) n * nSlot];
+  blockT  = new ULong64_t[(size_t) n * nSlot];
+  blockTf = new UShort_t[(size_t) n * nSlot];
+  blockSize = n;
+}
+
+int TreeReader::ReadBlock(Long64_t first, Long64_t last){
+
+  Long64_t nEntry = tree->GetEntries();
+  if( last > nEntry ) last = nEntry;
+  if( first >= last ) return 0;
+
+  TTree::TClusterIterator it = tree->GetClusterIterator(first);
+  it.Next();
+  Long64_t clusterEnd = it.GetNextEntry(); /// the baskets of the block are then read once
+  if( clusterEnd > first && clusterEnd < last ) last = clusterEnd;
+  if( last - first > blockCapacity ) last = first + blockCapacity;
+  int n = last - first;
+
+  ReserveBlock(n);
+  memset(blockE,  0, sizeof(UInt_t)    * n * nSlot);
+  memset(blockT,  0, sizeof(ULong64_t) * n * nSlot);
+  memset(blockTf, 0, sizeof(UShort_t)  * n * nSlot);
+
+  if( !isCompact ){ /// the branch buffers are the arrays of GetEntry(), copied row by row
+    for( int i = 0; i < n; i++){ brE->GetEntry(first + i); memcpy(blockE + i * nSlot, energy, sizeof(UInt_t) * nChannel);}
+    for( int i = 0; i < n; i++){ brT->GetEntry(first + i); memcpy(blockT + i * nSlot, timeStamp, sizeof(ULong64_t) * nChannel);}
+    if( brTf != NULL ){
+      for( int i = 0; i < n; i++){ brTf->GetEntry(first + i); memcpy(blockTf + i * nSlot, fineTime, sizeof(UShort_t) * nChannel);}
+    }
+    return n;
+  }
+
+  ///------ compact, the hit count first, then every column into flat arrays, then into the channel slots
+  blockN.resize(n);
+  int nTotal = 0;
+  for( int i = 0; i < n; i++){
+    brN->GetEntry(first + i);
+    blockN[i] = hitN > nChannel ? nChannel : hitN;
+    nTotal += blockN[i];
+  }
+  flatCh.resize(nTotal);
+  flatE.resize(nTotal);
+  flatT.resize(nTotal);
+  flatTf.assign(nTotal, 0);
+
+  int k = 0;
+  for( int i = 0; i < n; k += blockN[i], i++){ brCh->GetEntry(first + i); memcpy(flatCh.data() + k, hitCh, sizeof(UChar_t) * blockN[i]);}
+  k = 0;
+  for( int i = 0; i < n; k += blockN[i], i++){ brE->GetEntry(first + i);  memcpy(flatE.data() + k,  hitE,  sizeof(UInt_t) * blockN[i]);}
+  k = 0;
+  for( int i = 0; i < n; k += blockN[i], i++){ brT->GetEntry(first + i);  memcpy(flatT.data() + k,  hitT,  sizeof(ULong64_t) * blockN[i]);}
+  if( brTf != NULL ){
+    k = 0;
+    for( int i = 0; i < n; k += blockN[i], i++){ brTf->GetEntry(first + i); memcpy(flatTf.data() + k, hitTf, sizeof(UShort_t) * blockN[i]);}
+  }
+
+  k = 0;
+  for( int i = 0; i < n; i++){
+    size_t row = (size_t) i * nSlot;
+    for( int j = 0; j < blockN[i]; j++, k++){
+      int ch = flatCh[k];
+      if( ch >= nSlot ) continue;
+      blockE[row + ch]  = flatE[k];
+      blockT[row + ch]  = ( isDeltaTime && j > 0 ) ? flatT[k - j] + flatT[k] : flatT[k];
+      blockTf[row + ch] = flatTf[k];
+    }
+  }
+
+  return n;
+}
+
+#endif
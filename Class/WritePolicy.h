@@ -0,0 +1,219 @@
+#ifndef WRITEPOLICY
+#define WRITEPOLICY
+
+#include <stdio.h>
+#include <ctime>
+#include <sys/statvfs.h>
+#include "TString.h"
+#include "TSystem.h"
+#include "TTree.h"
+
+/// Graceful degradation of the output when the disk is slow or almost full.
+/// The level follows the depth of the writer queue and the free space of the output disk,
+///   0 normal
+///   1 drop waveforms, the events are saved without traces
+///   2 prescale singles, 1 in N events with a single hit is kept, coincidences are always kept
+///   3 no histogram-only work, the time-difference, multiplicity and single-hit histograms are not filled
+/// every level includes the ones below. The level goes up at once when a watermark is crossed, and
+/// down one step after holdSec below it. Each change is printed, the counts are saved as "writePolicy".
+/// The data path never waits, the policy only decides what is left out.
+
+class WritePolicy{
+public:
+
+  enum Level { kNormal = 0, kDropWave = 1, kPrescaleSingle = 2, kNoHistogram = 3, NLevel = 4 };
+
+  WritePolicy(TString outputPath); /// a file or directory on the output disk
+  ~WritePolicy(){};
+
+  void SetQueueMarks(int wave, int single, int histogram);             /// writer queue depth [batches], 0 = not used
+  void SetDiskMarks(double wave, double single, double histogram);     /// free disk [GB], 0 = not used
+  void SetPrescale(int n)       {prescale = n > 1 ? n : 1;}
+  void SetHoldSec(double sec)   {holdSec = sec;}
+
+  int  Update(int queueDepth);  /// once per update, returns the level
+  int  GetLevel()               {return level;}
+  static const char * GetLevelName(int level);
+
+  bool IsDropWave()             {return level >= kDropWave;}
+  bool IsHistogramOff()         {return level >= kNoHistogram;}
+  bool KeepEvent(int * channel, int nChannel);     /// false for a prescaled single
+  static bool IsSingle(int * channel, int nChannel);
+
+  void CountDroppedWave(int n = 1)        {droppedWave += n;}
+  void CountSkippedHistogram(int n = 1)   {skippedHistogram += n;}
+
+  double GetFreeDiskGB();
+  void   PrintStatistic();
+  TTree* MakeTree();  /// one entry per level, tree "writePolicy"
+
+private:
+
+  TString path;
+  int level;
+  int queueMark[NLevel];   /// [0] not used
+  double diskMark[NLevel];
+  int prescale;
+  double holdSec;
+
+  time_t lowSince;         /// the target level is below the level since, 0 = not
+  time_t lastUpdate;
+
+  int lastQueueDepth;
+  double lastFreeGB;
+
+  ULong64_t enterCount[NLevel];
+  double    levelSec[NLevel];
+  ULong64_t singleSeen;
+  ULong64_t droppedSingle;
+  ULong64_t droppedWave;
+  ULong64_t skippedHistogram;
+
+  int TargetLevel(int queueDepth, double freeGB);
+};
+
+WritePolicy::WritePolicy(TString outputPath){
+  path = outputPath;
+  level = kNormal;
+  for( int i = 0; i < NLevel; i++){
+    queueMark[i] = 0;
+    diskMark[i] = 0;
+    enterCount[i] = 0;
+    levelSec[i] = 0;
+  }
+  prescale = 10;
+  holdSec = 10;
+  lowSince = 0;
+  lastUpdate = time(NULL);
+  lastQueueDepth = 0;
+  lastFreeGB = -1;
+  singleSeen = 0;
+  droppedSingle = 0;
+  droppedWave = 0;
+  skippedHistogram = 0;
+}
+
+void WritePolicy::SetQueueMarks(int wave, int single, int histogram){
+  queueMark[kDropWave] = wave;
+  queueMark[kPrescaleSingle] = single;
+  queueMark[kNoHistogram] = histogram;
+}
+
+void WritePolicy::SetDiskMarks(double wave, double single, double histogram){
+  diskMark[kDropWave] = wave;
+  diskMark[kPrescaleSingle] = single;
+  diskMark[kNoHistogram] = histogram;
+}
+
+const char * WritePolicy::GetLevelName(int level){
+  switch( level ){
+    case kNormal         : return "normal";
+    case kDropWave       : return "drop waveforms";
+    case kPrescaleSingle : return "prescale singles";
+    case kNoHistogram    : return "no histograms";
+  }
+  return "unknown";
+}
+
+double WritePolicy::GetFreeDiskGB(){
+  struct statvfs fs;
+  TString where = gSystem->AccessPathName(path) ? TString(gSystem->DirName(path)) : path; /// the file may not exist yet
+  if( statvfs(where.Data(), &fs) != 0 ) return -1;
+  return (double) fs.f_bavail * fs.f_frsize / 1024. / 1024. / 1024.;
+}
+
+int WritePolicy::TargetLevel(int queueDepth, double freeGB){
+  int target = kNormal;
+  for( int i = kDropWave; i < NLevel; i++){
+    if( queueMark[i] > 0 && queueDepth >= queueMark[i] ) target = i;
+    if( diskMark[i] > 0 && freeGB >= 0 && freeGB <= diskMark[i] ) target = i;
+  }
+  return target;
+}
+
+int WritePolicy::Update(int queueDepth){
+  time_t now = time(NULL);
+  levelSec[level] += difftime(now, lastUpdate);
+  lastUpdate = now;
+
+  lastQueueDepth = queueDepth;
+  lastFreeGB = GetFreeDiskGB();
+  int target = TargetLevel(queueDepth, lastFreeGB);
+
+  int newLevel = level;
+  if( target > level ){
+    newLevel = target;
+    lowSince = 0;
+  }else if( target < level ){
+    if( lowSince == 0 ) lowSince = now;
+    if( difftime(now, lowSince) >= holdSec ){
+      newLevel = level - 1;
+      lowSince = 0;
+    }
+  }else{
+    lowSince = 0;
+  }
+
+  if( newLevel != level ){
+    printf("====== write policy : %s -> %s, queue %d, free disk %.1f GB\n",
+             GetLevelName(level), GetLevelName(newLevel), queueDepth, lastFreeGB);
+    level = newLevel;
+    enterCount[level] ++;
+  }
+  return level;
+}
+
+bool WritePolicy::IsSingle(int * channel, int nChannel){
+  int nHit = 0;
+  for( int ch = 0; ch < nChannel; ch++) if( channel[ch] >= 0 ) nHit ++;
+  return nHit < 2;
+}
+
+bool WritePolicy::KeepEvent(int * channel, int nChannel){
+  if( level < kPrescaleSingle || !IsSingle(channel, nChannel) ) return true;
+  singleSeen ++;
+  if( singleSeen % prescale == 0 ) return true;
+  droppedSingle ++;
+  return false;
+}
+
+void WritePolicy::PrintStatistic(){
+  printf(" Write policy %-16s | queue %3d | free disk %7.1f GB | dropped waves %llu, singles %llu | skipped histo %llu\n",
+           GetLevelName(level), lastQueueDepth, lastFreeGB, droppedWave, droppedSingle, skippedHistogram);
+}
+
+TTree * WritePolicy::MakeTree(){
+
+  levelSec[level] += difftime(time(NULL), lastUpdate);
+  lastUpdate = time(NULL);
+
+  TTree * tree = new TTree("writePolicy", "write policy, one entry per level");
+
+  int lv, qMark;
+  ULong64_t enter;
+  double sec, dMark;
+  ULong64_t dropWave = droppedWave, dropSingle = droppedSingle, skipHisto = skippedHistogram;
+
+  tree->Branch("level", &lv, "level/I");
+  tree->Branch("queueMark", &qMark, "queueMark/I");       /// batches
+  tree->Branch("diskMark", &dMark, "diskMark/D");         /// GB
+  tree->Branch("enter", &enter, "enter/l");               /// times the level was entered
+  tree->Branch("time", &sec, "time/D");                   /// sec at the level
+  tree->Branch("droppedWave", &dropWave, "droppedWave/l");        /// run totals, same in every entry
+  tree->Branch("droppedSingle", &dropSingle, "droppedSingle/l");
+  tree->Branch("skippedHistogram", &skipHisto, "skippedHistogram/l");
+
+  for( int i = 0; i < NLevel; i++){
+    lv = i;
+    qMark = queueMark[i];
+    dMark = diskMark[i];
+    enter = enterCount[i];
+    sec = levelSec[i];
+    tree->Fill();
+  }
+
+  tree->ResetBranchAddresses();
+  return tree;
+}
+
+#endif
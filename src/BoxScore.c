@@ -50,12 +50,15 @@
 //#include "../Class/IsoDetect.h"
 #include "../Class/HelioArray.h"
 #include "../Class/MCPClass.h"
+#include "../Class/LatencyMonitor.h"
+#include "../Class/RawHitWriter.h"
+#include "../Class/ArrowWriter.h"
+#include "../Class/WritePolicy.h"
 
 using namespace std;
 
 //========== General setting , there are the most general setting that should be OK for all experiment.
 int updatePeriod = 1000; ///Table, tree, Plots update period in mili-sec.
-///bool isSaveRaw = false;  /// saving Raw data
 bool isDataBaseExist = false;
 string location;
 bool  QuitFlag = false;
@@ -64,6 +67,10 @@ uint32_t StartTime = 0, StopTime, CurrentTime, ElapsedTime;
 Digitizer * dig;
 GenericPlane * gp;
 FileIO * file;
+LatencyMonitor * latency;
+RawHitWriter * rawWriter = NULL; /// raw hit stream, when enabled in generalSetting.txt
+ArrowWriter * arrowWriter = NULL; /// Arrow IPC stream of the built events, when enabled in generalSetting.txt
+WritePolicy * policy = NULL; /// output degradation under disk pressure, when enabled in generalSetting.txt
 string folder; 
 TString rootFileName;
 TString cutopt, cutFileName, archiveCutFile; 
@@ -153,6 +160,8 @@ int main(int argc, char *argv[]){
     return -1;
   }
 
+  ROOT::EnableThreadSafety(); /// the file writer runs in its own thread
+
   cutopt = "RECREATE"; // by default
   cutFileName = "data/cutsFile.root"; // default
 
@@ -223,6 +232,9 @@ int main(int argc, char *argv[]){
   gp->SetChannelGain(dig->GetChannelGain(), dig->GetInputDynamicRange(), dig->GetNChannel());
   gp->SetCoincidentTimeWindow(dig->GetCoincidentTimeWindow());
   gp->SetChannelsPlotRange(dig->GetChannelsPlotRange());
+  gp->SetTimeStampUnit(dig->GetFineTimeToNanoSec()); /// Fill() is given the combined high-resolution time stamp
+  dig->SetNChannelForRealEvent(gp->GetNChannelForRealEvent());
+  dig->GetLiveTime()->MarkPeriod(gp->GetChannelMask());
   gp->SetGenericHistograms(); ///must be after SetChannelGain
   
   /* DB push of general settings info */
@@ -249,24 +261,59 @@ int main(int argc, char *argv[]){
 
   folder = "setting/";/// +  expName;
   file = new FileIO(rootFileName);
+  file->SetCompression(dig->GetCompressionAlgorithm(), dig->GetCompressionLevel(), dig->GetBasketSize(), dig->GetAutoFlushMB());
+  if( dig->GetImplicitMTThreads() > 0 ) ROOT::EnableImplicitMT(dig->GetImplicitMTThreads()); /// parallel basket compression
+  file->SetRollover(dig->GetRolloverMB(), dig->GetRolloverSec());
 
-  ///==== Save setting into the root file
-  TMacro gSetting((folder + "generalSetting.txt").c_str());
-  gSetting.Write("generalSetting");
+  ///==== Save setting into the root file, and into every segment
+  file->WriteMacro((folder + "generalSetting.txt").c_str(), "generalSetting");
   for( int i = 0 ; i < NChannels; i++){
     if (ChannelMask & (1<<i)) {
-      TMacro chSetting(Form("%ssetting_%i.txt", folder.c_str(), i));
-      chSetting.Write(Form("setting_%i", i));
+      file->WriteMacro(Form("%ssetting_%i.txt", folder.c_str(), i), Form("setting_%i", i));
     }
   }
+  file->SetTreeSchema(dig->IsTreeCompact(), dig->IsTreeDeltaTime(), dig->IsTreeWave());
+  file->SetWaveLayout(dig->GetTreeWaveLayout(), dig->Getch2ns(), dig->Getch2ns(), NChannels, dig->GetPreTriggerSizes()); /// 1 sample = 1 ch for the V1730
   file->SetTree("tree", NChannels);
-  file->Close();
+  file->SetTimeIndex(1., dig->Getch2ns()); /// 1 sec buckets
+  if( gp->GetCutList() != NULL ) file->SetIndexCuts(gp->GetCutList(), gp->GetdEChannel(), gp->GetEChannel());
+  file->SetPersistent(dig->IsFilePersistent(), dig->GetFileAutoSaveSec(), dig->GetFileAutoSaveMB());
+  file->SetSnapshot(dig->GetSnapshotSec()); /// for BoxScoreReader -f
+  file->Save();
+
+  latency = new LatencyMonitor();
+  file->SetLatencyMonitor(latency);
+  if( dig->GetArrowOutput() > 0 && dig->GetAcqMode() == "list" ) {
+    TString arrowFileName = rootFileName;
+    arrowFileName.ReplaceAll(".root", ".arrows");
+    if( !arrowFileName.EndsWith(".arrows") ) arrowFileName += ".arrows";
+    arrowWriter = new ArrowWriter(arrowFileName, NChannels, dig->Getch2ns());
+    if( arrowWriter->IsOpen() ) file->SetArrowWriter(arrowWriter, dig->GetArrowOutput() == 1);
+  }
+  file->StartWriter();
 
-  FileIO * rawFile = NULL ;
-  ///if( isSaveRaw ) {
-    ///rawFile = new FileIO("raw.root");
-    ///rawFile->SetTree("rawTree", 1);
-  ///}
+  if( dig->IsWritePolicy() ){
+    policy = new WritePolicy(rootFileName);
+    policy->SetQueueMarks(dig->GetPolicyQueueMark(0), dig->GetPolicyQueueMark(1), dig->GetPolicyQueueMark(2));
+    policy->SetDiskMarks(dig->GetPolicyDiskMark(0), dig->GetPolicyDiskMark(1), dig->GetPolicyDiskMark(2));
+    policy->SetPrescale(dig->GetPolicyPrescale());
+  }
+
+  if( dig->IsSaveRawHit() && dig->GetAcqMode() == "list" ) {
+    TString rawFileName = rootFileName;
+    rawFileName.ReplaceAll(".root", ".raw");
+    if( !rawFileName.EndsWith(".raw") ) rawFileName += ".raw";
+    rawWriter = new RawHitWriter(rawFileName, dig->GetRawHitFileHeader(), dig->GetRawBlockSizeMB(),
+                                 dig->GetRawBufferCount(), dig->IsRawDirectIO(), dig->GetRawPreallocMB());
+    if( rawWriter->IsOpen() ) dig->SetRawHitWriter(rawWriter);
+  }
+
+  if( dig->GetCheckpointSec() > 0 && dig->GetAcqMode() == "list" ) {
+    TString histoFileName = rootFileName;
+    histoFileName.ReplaceAll(".root", ".histo.root");
+    if( !histoFileName.EndsWith(".histo.root") ) histoFileName += ".histo.root";
+    gp->SetCheckpoint(histoFileName, dig->GetCheckpointSec());
+  }
 
   thread paintCanvasThread(paintCanvas); /// using thread and loop keep Canvas responding
 
@@ -303,6 +350,7 @@ void EventLoop(){
   PrintCommands();
 
   const unsigned long long int ch2ns = dig->GetChannelToNanoSec();
+  ULong64_t timeStampHR[MaxNChannels]; /// coarse + fine time stamp of a built event
 
   //##################################################################
   while(!QuitFlag) {
@@ -337,7 +385,12 @@ void EventLoop(){
          int * chRaw = dig->GetRawChannel();
          ULong64_t * timeRaw = dig->GetRawTimeStamp();
          int nRaw = dig->GetNumRawEvent();
-         file->FillTreeWave(gp->GetWaveForm1(), gp->GetWaveEnergy(), nRaw, chRaw, timeRaw);
+         if( policy != NULL && policy->IsDropWave() ){ /// the energies only
+           file->FillTreeWave(NULL, NULL, NULL, gp->GetWaveEnergy(), nRaw, chRaw, timeRaw);
+           policy->CountDroppedWave();
+         }else{
+           file->FillTreeWave(gp->GetWaveForm1(), dig->GetWaveFormLengths(), dig->GetWaveForms1(), gp->GetWaveEnergy(), nRaw, chRaw, timeRaw);
+         }
         gp->ClearWaveEnergies();
        }else{
          gp->DrawWaves();
@@ -345,12 +398,6 @@ void EventLoop(){
        dig->ClearRawData(); /// clean up raw data, as no event build, the raw data accumulate, that will reflect the actual trigger rate
     }
 
-    ///if( isSaveRaw ) {
-      ///for( int i = 0 ; i < dig->GetNumRawEvent(); i++){
-      ///  rawfile->FillTree();
-      ///}
-    ///}
-
     //##################################################################
     CurrentTime = get_time();
     ElapsedTime = CurrentTime - PreviousTime; /// milliseconds
@@ -366,26 +413,33 @@ void EventLoop(){
       PreviousTime = CurrentTime;
 
       double fileSize = file->GetFileSize() ;
-      printf("Built-event save to  : %s \n", rootFileName.Data());
+      printf("Built-event save to  : %s \n", file->GetFileName().Data());
       printf("File size            : %.4f MB \n", fileSize );
       printf("\n");
 
       dig->PrintReadStatistic();
+      if( policy != NULL ) {
+        policy->Update(file->GetQueueDepth());
+        policy->PrintStatistic();
+      }
 
     }
 
     
     if (ElapsedTime > updatePeriod && dig->GetAcqMode() == "list") {
       if (gp->GetCanvasID() == 2) gp->ClearHistograms();
+      if( policy != NULL ) policy->Update(file->GetQueueDepth());
+      bool isHistogramOff = policy != NULL && policy->IsHistogramOff();
+
       //======================== Fill TDiff
-      for( int i = 0; i < dig->GetNumRawEvent() - 1; i++){
+      if( isHistogramOff ) policy->CountSkippedHistogram();
+      for( int i = 0; i < dig->GetNumRawEvent() - 1 && !isHistogramOff; i++){
         ///~ ULong64_t timeDiff = dig->GetRawTimeStamp(i+1) - dig->GetRawTimeStamp(i);
         float timeDiff = (float)(dig->GetTimeStamp(i+1) - dig->GetTimeStamp(i));
         ///~ printf("timeDiff: %12.12f \n",timeDiff);
         gp->FillTimeDiff((float)timeDiff * 2.0);
       }
 
-      file->Append();
       double fileSize = file->GetFileSize() ;
       
       uint32_t b0 = get_time();
@@ -405,16 +459,38 @@ void EventLoop(){
       
       uint32_t c0 = get_time();
       if( dig->GetNumRawEvent() > 0  && buildID == 1 ) {
+        ///------ hand the events to the writer thread, then fill histograms while it writes
+        EventBatch * batch = file->GetFreeBatch();
         for( int i = 0; i < dig->GetEventBuiltCount(); i++){
-          file->FillTree(dig->GetChannel(i), dig->GetEnergy(i), dig->GetTimeStamp(i));
-          gp->Fill(dig->GetEnergy(i), dig->GetTimeStamp(i));//crh
+          if( policy != NULL && !policy->KeepEvent(dig->GetChannel(i), dig->GetNChannel()) ) { /// prescaled single, in the live time
+            for( int ch = 0; ch < dig->GetNChannel(); ch++) if( dig->GetChannel(i, ch) >= 0 ) dig->GetLiveTime()->AddPrescaled(ch);
+            continue;
+          }
+          batch->Add(dig->GetChannel(i), dig->GetEnergy(i), dig->GetTimeStamp(i), dig->GetFineTime(i), dig->GetEventReadTime(i));
+        }
+        ULong64_t droppedHit[MaxNChannels] = {0};
+        if( !file->PushBatch(batch, droppedHit) ){ /// writer queue full, the hits are dropped, still in the histograms
+          for( int ch = 0; ch < dig->GetNChannel(); ch++) if( droppedHit[ch] > 0 ) dig->GetLiveTime()->AddDropped(ch, droppedHit[ch]);
+        }
+
+        for( int i = 0; i < dig->GetEventBuiltCount(); i++){
+          ULong64_t hitTime = dig->GetEventReadTime(i);
+          latency->Record(LatencyMonitor::kBuild, hitTime, dig->GetEventEmitTime());
+          if( isHistogramOff && WritePolicy::IsSingle(dig->GetChannel(i), dig->GetNChannel()) ) {
+            policy->CountSkippedHistogram();
+            continue;
+          }
+          for( int ch = 0; ch < dig->GetNChannel(); ch++) timeStampHR[ch] = dig->GetTimeStampHR(i, ch);
+          gp->Fill(dig->GetEnergy(i), timeStampHR);//crh
+          latency->Record(LatencyMonitor::kFiller, hitTime, LatencyMonitor::NowMicroSec());
         }
       }
-      file->Close();
+      file->Save();
+      if( rawWriter != NULL ) rawWriter->Flush();
       uint32_t c1 = get_time();
       
       
-      gp->FillHit(dig->GetNChannelEventCount());
+      if( !isHistogramOff ) gp->FillHit(dig->GetNChannelEventCount());
 
       float timeRangeSec = dig->GetRawTimeRange() * 2e-9;
       string tag = "tag=" + location;
@@ -430,8 +506,7 @@ void EventLoop(){
       //  totalRate = gp->GetdEECount()/timeRangeSec;
       //  //aveRate = gp->GetdEECount(10.0);
       //}else{
-         int nCH = gp->GetNChannelForRealEvent(); /// get the event count for N-channels
-         totalRate = dig->GetNChannelEventCount(nCH)*1.0/timeRangeSec;
+         totalRate = dig->GetRealEventRate(1); /// sliding window on time stamp, 10 sec by default
          //aveRate = dig->GetNChannelEventCount(nCH,10.0): //average over run
       //}
       if( totalRate >= 0.)gp->FillRateGraph((CurrentTime - StartTime)/1e3, totalRate);
@@ -440,6 +515,7 @@ void EventLoop(){
       
       //============ Draw histogram
       gp->Draw();
+      gp->CheckpointIfDue(); /// the changed histograms, in the background
 
       uint32_t pTime = get_time();
       //=========================== Display
@@ -447,27 +523,40 @@ void EventLoop(){
       PrintCommands();
       printf("\n======== Tree, Histograms, and Table update every ~%.2f sec\n", updatePeriod/1000.);
       printf("Events building      : %f sec\n", (b1 - b0)/ 1000.);
-      printf("file saving          : %f sec\n", (c1 - c0)/ 1000.);
+      printf("file saving & filling: %f sec\n", (c1 - c0)/ 1000.);
       printf("database             : %f sec\n", (c2 - c1)/ 1000.);
       printf("Drawing              : %f sec\n", (pTime - c2)/ 1000.);
       printf("Processing Time      : %f sec\n", (pTime - CurrentTime)/ 1000.);
       printf("Time Elapsed         = %.3f sec = %.1f min\n", (CurrentTime - StartTime)/1e3, (CurrentTime - StartTime)/1e3/60.);
-      printf("Built-event save to  : %s \n", rootFileName.Data());
+      printf("Built-event save to  : %s \n", file->GetFileName().Data());
       printf("File size            : %.4f MB \n", fileSize );
       printf("Database             : %s\n", dbName.c_str());
 
       printf("\n");
       dig->PrintReadStatistic();
       dig->PrintEventBuildingStat(updatePeriod);
+      file->PrintWriterStatistic();
+      if( rawWriter != NULL ) rawWriter->PrintStatistic();
+      if( arrowWriter != NULL ) arrowWriter->PrintStatistic();
+      if( policy != NULL ) policy->PrintStatistic();
+      if( gp->GetCheckpoint() != NULL ) gp->GetCheckpoint()->PrintStatistic();
+      latency->Print();
+      printf("===============================================\n");
+      dig->GetLiveTime()->Print(gp->GetChannelMask());
+      printf("===============================================\n");
+      double liveFraction = dig->GetLiveTime()->GetPeriodLiveFraction();
       printf(" Rate( all) :%7.2f pps\n", totalRate);
       if(gp->IsCutFileOpen()){
         for( int i = 0 ; i < gp->GetNumCut(); i++ ){
           double count = gp->GetCountOfCut(i)*1.0/timeRangeSec;
-          printf(" Rate(%4s) :%7.2f pps\n", gp->GetCutName(i).Data(), count);
+          if( liveFraction > 0 ) count = count / liveFraction; /// live-time corrected
+          printf(" Rate(%4s) :%7.2f pps (live %.2f%%)\n", gp->GetCutName(i).Data(), count, liveFraction * 100.);
           //----------------- write to database
           WriteToDataBase(dbName, gp->GetCutName(i).Data(), tag, count);
         }
+        WriteToDataBase(dbName, "liveFraction", tag, liveFraction);
       }
+      dig->GetLiveTime()->MarkPeriod(gp->GetChannelMask());
       
       dig->ClearData();
       PreviousTime = CurrentTime;
@@ -477,7 +566,9 @@ void EventLoop(){
     if( isTimedACQ && CurrentTime - StartTime > timeLimitSec * 1000) {
       dig->StopACQ();
       dig->ClearRawData();
+      file->Drain();
       if( file->isOpen() ) file->Close();
+      if( rawWriter != NULL ) { rawWriter->Flush(); rawWriter->Drain(); }
       PrintCommands();
       printf("=========== time-up.\n");
     }
@@ -485,22 +576,42 @@ void EventLoop(){
   } //============== End of readout loop
    
 
-  ///if( isSaveRaw ) {
-    ///rawFile->Close();
-  ///}
+  if( rawWriter != NULL ) {
+    dig->SetRawHitWriter(NULL);
+    rawWriter->Close();
+    delete rawWriter;
+    rawWriter = NULL;
+  }
 
 
   ///============ wirte histogram into tree
-  // TODO, a generic method for saving all histogram even in derivative class
+  file->StopWriter(); /// drain the queued events
+  if( arrowWriter != NULL ) {
+    file->SetArrowWriter(NULL, true);
+    arrowWriter->Close();
+    delete arrowWriter;
+    arrowWriter = NULL;
+  }
   file->Append();
-  file->WriteHistogram(gp->GethdEtotE());
-  file->WriteHistogram(gp->GethE());
-  file->WriteHistogram(gp->GethdE());
-  file->WriteHistogram(gp->GethtotE());
-  file->WriteHistogram(gp->GethdEE());
-  file->WriteHistogram(gp->GethTDiff());
-  file->WriteHistogram(gp->GetRateGraph(), "rateGraph");
+  vector<TObject *> histList = gp->GetHistogramList(); /// every registered histogram, also of the derivative class
+  for( int i = 0; i < (int) histList.size(); i++) file->WriteHistogram(histList[i]);
+  for( int s = 0; s < LatencyMonitor::NStage; s++){
+    TH1F * hLatency = latency->MakeHistogram(s);
+    file->WriteHistogram(hLatency);
+    delete hLatency;
+  }
+  dig->GetLiveTime()->Stop();
+  TTree * liveTree = dig->GetLiveTime()->MakeTree(gp->GetChannelMask());
+  file->WriteTree(liveTree);
+  delete liveTree;
+  if( policy != NULL ){
+    TTree * policyTree = policy->MakeTree();
+    file->WriteTree(policyTree);
+    delete policyTree;
+  }
   file->Close();
+  file->EndSnapshot();
+  gp->EndCheckpoint(true); /// all in the root file now
    
 }
  
@@ -574,9 +685,7 @@ void keyPressCommand(){
   if (c == 'q') { //========== quit
     QuitFlag = true;
     if( gp->IsCutFileOpen() ) {
-      file->Append();
-      file->WriteObjArray(gp->GetCutList());
-      file->Close();
+      file->AppendObjArray(gp->GetCutList());
     }
   }
   if ( c == 'y'){ //========== reset histograms
@@ -599,7 +708,9 @@ void keyPressCommand(){
     dig->ClearRawData();
     dig->ClearData();
     StopTime = get_time();
+    file->Drain();
     if( file->isOpen() ) file->Close();
+    if( rawWriter != NULL ) { rawWriter->Flush(); rawWriter->Drain(); }
     printf("========== Duration : %u msec\n", StopTime - StartTime);
   }
   if ( c == 'T'){ //============ Timed acquisition
@@ -630,9 +741,8 @@ void keyPressCommand(){
       temp = scanf("%d", &threshold);
       printf("OK, the threshold of ch-\e[33m%d\e[0m change to \e[33m%d\e[0m. \n", channel, threshold);
       dig->SetChannelThreshold(channel, folder, threshold);
-      file->Append();
-      file->WriteMacro(Form("%s/setting_%i.txt", folder.c_str(), channel));
-      file->Close();
+      file->Journal("threshold", channel, present_threshold, threshold);
+      file->UpdateMacro(Form("%s/setting_%i.txt", folder.c_str(), channel));
     }
     uncooked();
   }
@@ -648,10 +758,9 @@ void keyPressCommand(){
       printf(" !!!!!!! Channel is closed. \n");
     }else{
       int dyRange = (dig->GetChannelDynamicRange(channel) == 0 ? 1 : 0);
+      file->Journal("dynamicRange", channel, dig->GetChannelDynamicRange(channel), dyRange);
       dig->SetChannelDynamicRange(channel, folder, dyRange);
-      file->Append();
-      file->WriteMacro(Form("%s/setting_%i.txt", folder.c_str(), channel));
-      file->Close();
+      file->UpdateMacro(Form("%s/setting_%i.txt", folder.c_str(), channel));
     }
     uncooked();
   }
@@ -675,6 +784,7 @@ void keyPressCommand(){
        printf("----> load from %s\n", loadfile);
        dig->LoadChannelSetting(ch, loadfile);
        int ret = dig->ProgramChannels();
+       file->Journal("channelFile", ch, 0, ret, loadfile);
        printf("==================");
        ret == 0 ? printf(" Changed.\n") : printf("Fail.\n");
     }else{
@@ -689,6 +799,7 @@ void keyPressCommand(){
     int coinTime;
     printf("\nChange coincident time window from \e[33m%d\e[0m ns to ? ", dig->GetCoincidentTimeWindow());
     int temp = scanf("%d", &coinTime);
+    file->Journal("coincidentWindow", -1, dig->GetCoincidentTimeWindow(), coinTime);
     dig->SetCoincidentTimeWindow(coinTime);
     gp->SetCoincidentTimeWindow(coinTime);
     printf("Done, the coincident time window is now \e[33m%d\e[0m.\n", dig->GetCoincidentTimeWindow());
@@ -708,6 +819,7 @@ void keyPressCommand(){
        ///int temp = scanf("%d", &length);
        ///dig->SetAcqMode("mixed", length);
        dig->SetAcqMode("mixed"); /// if no length input, the record length is same as genernal setting
+       file->Journal("acqMode", -1, 0, 0, "mixed");
        gp->SetWaveCanvas((int) dig->GetRecordLength());
        ///dig->StartACQ();
        isIntegrateWave = false;
@@ -720,6 +832,7 @@ void keyPressCommand(){
     dig->ClearRawData();
     printf("\n\n###############################\n");
     dig->SetAcqMode("mixed");
+    file->Journal("acqMode", -1, 0, 0, "mixed, integrate wave");
     gp->SetCanvasTitleDivision(location + " | " + rootFileName);
     gp->Draw();
     isIntegrateWave = true;
@@ -732,6 +845,7 @@ void keyPressCommand(){
       dig->ClearRawData();
       printf("Change to List mode.\n");
       dig->SetAcqMode("list");
+      file->Journal("acqMode", -1, 0, 0, "list");
       gp->SetCanvasTitleDivision(location + " | " + rootFileName);
       gp->Draw();
     }
@@ -812,7 +926,7 @@ void keyPressCommand(){
     int chT = gp->GetTChannel();
 
 
-    string expression = "./CutsCreator " + (string)rootFileName + " " ;
+    string expression = "./CutsCreator " + (string)file->GetFileName() + " " ; /// the current segment with rollover
     expression = expression + (string)cutopt + " ";
     expression = expression + to_string(chDE) + " ";
     expression = expression + to_string(chE) + " ";
@@ -828,6 +942,7 @@ void keyPressCommand(){
 
     gp->LoadCuts(cutFileName);
     gp->Draw();
+    if( gp->GetCutList() != NULL ) file->SetIndexCuts(gp->GetCutList(), gp->GetdEChannel(), gp->GetEChannel());
     uncooked();
   }
   if( (c == 'r' || c == 't' || c == 'f' ) && dig->GetAcqMode() == "mixed"){  ////========== Set Trapezoid rise time, only for wave mode
@@ -854,6 +969,7 @@ void keyPressCommand(){
     printf("Present %s %d [ch] = %d [ns], New setting in [ch] ?", settingType.c_str(), old_setting, old_setting * 2);
     temp = scanf("%d", &setting);
     setting = setting/8*8;
+    file->Journal(c == 'r' ? "riseTime" : c == 't' ? "flatTop" : "decay", ch, old_setting, setting);
     if( c == 'r') {
       gp->SetRiseTime(ch, setting);
       dig->SetChannelRiseTime(ch, folder, setting);
@@ -877,6 +993,7 @@ void keyPressCommand(){
     int setting;
     printf("Present Base-Line-End %d [ch] = %d [ns], New setting in [ch] ?", old_setting, old_setting * 2);
     temp = scanf("%d", &setting);
+    file->Journal("baseLineEnd", ch, old_setting, setting);
     gp->SetBaseLineEnd(ch, setting);
     uncooked();
   }
@@ -888,6 +1005,7 @@ void keyPressCommand(){
     int length = dig->GetRecordLength(); /// in ch
     printf("Set Record Length in [ns] ( present : %d [ch])? ", dig->GetRecordLength());
     int temp = scanf("%d", &length);
+    file->Journal("recordLength", -1, dig->GetRecordLength(), length);
     dig->SetAcqMode("mixed", length);
     uncooked();
   }
@@ -902,6 +1020,7 @@ void keyPressCommand(){
     int type = 0;
     printf("Set probe type by [0- 31]: " );
     temp = scanf("%d", &type);
+    file->Journal("probe", -1, 0, type, Form("virtual probe %d = type %d", probeID, type));
     dig->SetVirtualProbe(probeID, type);
     uncooked();
   }
@@ -0,0 +1,560 @@
+/******************************************************************************
+*  This program merges the root files of BoxScore into one time ordered "tree",
+*  e.g. the files of the boards of one run, or the runs of one experiment.
+*
+*  Every input is read by its own thread, the events are sorted within the
+*  disorder window and handed over in blocks through a short queue, so the
+*  memory does not grow with the size of the files. The main thread merges the
+*  blocks by time and the writer thread of FileIO compresses the output and
+*  re-builds the time index. The histograms of the same name and board are
+*  summed by a pool of threads, the setting macros are copied.
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <queue>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "TROOT.h"
+#include "TString.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TKey.h"
+#include "TClass.h"
+#include "TH1.h"
+#include "TMacro.h"
+#include "TObjString.h"
+
+#include "../Class/TreeReader.h"
+#include "../Class/FileIO.h"
+
+using namespace std;
+
+#define MaxNChannels 64
+
+//============ the merge setting
+ULong64_t disorderCh = 500000000;   /// ch, events further out of order in an input are counted as late
+int       blockSize = 10000;        /// events per block
+int       maxQueue = 4;             /// blocks waiting per input
+
+//============ events of one input, time ordered, channel indexed as in the input
+struct Block{
+  int nEvent;
+  int nChannel;
+  vector<ULong64_t> firstTime;   /// nEvent
+  vector<UInt_t>    energy;      /// nEvent x nChannel
+  vector<ULong64_t> timeStamp;   /// 0 = no hit
+  vector<UShort_t>  fineTime;
+};
+
+struct Input{
+  TString   fileName;
+  int       chOffset;       /// added to the channel, for the files of different boards
+  int       nChannel;
+  Long64_t  nEntry;
+  bool      hasIndex;
+  ULong64_t firstTime;      /// ch, from the time index
+  ULong64_t lastTime;
+  int       ch2ns;
+  Long64_t  timeShift;      /// ch, added to every time stamp
+
+  mutex m;
+  condition_variable cond;
+  deque<Block *> queue;
+  bool done;
+
+  Long64_t  nRead;
+  ULong64_t nLate;
+  vector<TH1 *>    histograms;
+  vector<TMacro *> macros;
+
+  Block *   current;        /// being merged
+  int       pos;
+};
+
+/* ###########################################################################
+*  Functions
+*  ########################################################################### */
+
+/// the histograms and the setting macros of the file, latest cycle of each key
+void LoadObjects(TFile * f, Input * in){
+  vector<TString> seen;
+  TIter next(f->GetListOfKeys());
+  while( TKey * key = (TKey *) next() ){
+    TString name = key->GetName();
+    if( find(seen.begin(), seen.end(), name) != seen.end() ) continue; /// older cycle
+    seen.push_back(name);
+    TClass * cl = TClass::GetClass(key->GetClassName());
+    if( cl == NULL ) continue;
+    if( cl->InheritsFrom("TH1") ){
+      TH1 * h = (TH1 *) key->ReadObj();
+      h->SetDirectory(0);
+      in->histograms.push_back(h);
+    }else if( cl->InheritsFrom("TMacro") ){
+      in->macros.push_back((TMacro *) key->ReadObj());
+    }
+  }
+}
+
+/// an event in the disorder window of an input, ordered by time, then by the order of reading
+struct Pending{
+  ULong64_t time;
+  Long64_t  seq;
+  int       slot;   /// in the window storage
+  bool operator>(const Pending &p) const { return time != p.time ? time > p.time : seq > p.seq; }
+};
+
+Block * NewBlock(int nChannel){
+  Block * b = new Block();
+  b->nEvent = 0;
+  b->nChannel = nChannel;
+  return b;
+}
+
+/// hand a time ordered block to the merge, wait while the queue of the input is full
+void PushBlock(Input * in, Block * out){
+  unique_lock<mutex> lock(in->m);
+  in->cond.wait(lock, [in]{ return (int) in->queue.size() < maxQueue; });
+  in->queue.push_back(out);
+  lock.unlock();
+  in->cond.notify_all();
+}
+
+void ReadInput(Input * in){
+
+  TFile * f = new TFile(in->fileName, "READ");
+  TTree * tree = (TTree *) f->Get("tree");
+  LoadObjects(f, in);
+
+  int nCh = in->nChannel;
+
+  /// the disorder window, a min-heap of the events, their hits in slots of nCh, re-used once emitted
+  priority_queue<Pending, vector<Pending>, greater<Pending> > window;
+  vector<UInt_t>    slotE;
+  vector<ULong64_t> slotT;
+  vector<UShort_t>  slotTf;
+  vector<int>       freeSlot;
+
+  Block * out = NewBlock(nCh);
+  ULong64_t lastEmitTime = 0;
+
+  /// move the events older than limit to the block, in time order, a full block goes to the merge
+  auto EmitBefore = [&](ULong64_t limit){
+    while( !window.empty() && window.top().time < limit ){
+      Pending p = window.top();
+      window.pop();
+      int j = p.slot * nCh;
+      out->firstTime.push_back(p.time);
+      out->energy.insert(out->energy.end(), slotE.begin() + j, slotE.begin() + j + nCh);
+      out->timeStamp.insert(out->timeStamp.end(), slotT.begin() + j, slotT.begin() + j + nCh);
+      out->fineTime.insert(out->fineTime.end(), slotTf.begin() + j, slotTf.begin() + j + nCh);
+      out->nEvent ++;
+      freeSlot.push_back(p.slot);
+      lastEmitTime = p.time;
+      if( out->nEvent >= blockSize ){
+        PushBlock(in, out);
+        out = NewBlock(nCh);
+      }
+    }
+  };
+
+  ULong64_t maxTime = 0;
+  if( tree != NULL ){
+    TreeReader reader(tree);
+    for( Long64_t ev = 0; ev < in->nEntry; ev++){
+      if( reader.GetEntry(ev) == 0 ) continue;
+      ULong64_t * ts = reader.GetTimeStamp();
+      UInt_t * e = reader.GetEnergy();
+      UShort_t * tf = reader.GetFineTime();
+
+      int slot;
+      if( freeSlot.empty() ){
+        slot = slotE.size() / nCh;
+        slotE.resize(slotE.size() + nCh);
+        slotT.resize(slotT.size() + nCh);
+        slotTf.resize(slotTf.size() + nCh);
+      }else{
+        slot = freeSlot.back();
+        freeSlot.pop_back();
+      }
+
+      ULong64_t first = (ULong64_t) -1;
+      for( int ch = 0; ch < nCh; ch++){
+        ULong64_t t = ts[ch];
+        if( t != 0 ){
+          Long64_t shifted = (Long64_t) t + in->timeShift;
+          t = shifted > 0 ? shifted : 1;
+          if( t < first ) first = t;
+        }
+        slotE[slot * nCh + ch]  = e[ch];
+        slotT[slot * nCh + ch]  = t;
+        slotTf[slot * nCh + ch] = tf[ch];
+      }
+      Pending p;
+      p.time = first;
+      p.seq = in->nRead;
+      p.slot = slot;
+      window.push(p);
+      in->nRead ++;
+
+      if( first < lastEmitTime ) in->nLate ++; /// behind what is already merged, kept, but out of order
+      if( first > maxTime ) maxTime = first;
+
+      /// the memory is the events of the disorder window and the queue
+      if( maxTime > disorderCh ) EmitBefore(maxTime - disorderCh);
+    }
+  }
+  EmitBefore((ULong64_t) -1); /// the rest, an event without hit ( first = all ones ) is not merged
+  if( out->nEvent > 0 ) {
+    PushBlock(in, out);
+  }else{
+    delete out;
+  }
+
+  {
+    lock_guard<mutex> lock(in->m);
+    in->done = true;
+  }
+  in->cond.notify_all();
+
+  f->Close();
+  delete f;
+}
+
+/// the next block of the input, false when the input is over
+bool NextBlock(Input * in){
+  if( in->current != NULL ) delete in->current;
+  in->current = NULL;
+  in->pos = 0;
+  while( true ){
+    unique_lock<mutex> lock(in->m);
+    in->cond.wait(lock, [in]{ return !in->queue.empty() || in->done; });
+    if( in->queue.empty() ) return false;
+    Block * b = in->queue.front();
+    in->queue.pop_front();
+    lock.unlock();
+    in->cond.notify_all();
+    if( b->nEvent == 0 ) { delete b; continue;}
+    in->current = b;
+    return true;
+  }
+}
+
+TString MacroText(TMacro * macro){
+  TString text;
+  TIter next(macro->GetListOfLines());
+  while( TObjString * line = (TObjString *) next() ) text += line->GetString() + "\n";
+  return text;
+}
+
+/* ########################################################################### */
+/* MAIN                                                                        */
+/* ########################################################################### */
+int main(int argc, char *argv[]){
+
+  if( argc < 3 ) {
+    printf("usage:\n");
+    printf("$./BoxScoreMerge [output.root] [input1.root] [input2.root(@chOffset)] ... (options)\n");
+    printf("       @chOffset  : added to the channels of the input, e.g. run.board2.root@16\n");
+    printf("     -j  nThread  : threads to sum the histograms, default = all cores\n");
+    printf("     -s           : sequential runs, each input starts after the last event of the previous one\n");
+    printf("     -d  sec      : maximum time disorder inside an input, default 1\n");
+    printf("     -b  nEvent   : events per block, default 10000\n");
+    printf("     -z  alg lvl  : compression, 1 ZLIB, 2 LZMA, 4 LZ4, 5 ZSTD, default 4 1\n");
+    printf("     -fixed       : fixed ch/e/t/tf[NChannel] schema, default compact\n");
+    printf("  the histograms are summed by name for the inputs of the same chOffset, else kept as boardN_name,\n");
+  printf("  N in the order of the offsets. The journal, the live time and the write policy of the inputs are not merged.\n");
+    return -1;
+  }
+
+  ROOT::EnableThreadSafety();
+
+  TString outFileName = argv[1];
+  vector<Input *> inputs;
+  int nThread = thread::hardware_concurrency();
+  bool isSequential = false;
+  double disorderSec = 1.;
+  int compAlg = 4, compLevel = 1;
+  bool isCompact = true;
+
+  for( int i = 2; i < argc; i++){
+    string arg = argv[i];
+    if( arg == "-j" && i + 1 < argc ) { nThread = atoi(argv[++i]); continue;}
+    if( arg == "-s" ) { isSequential = true; continue;}
+    if( arg == "-d" && i + 1 < argc ) { disorderSec = atof(argv[++i]); continue;}
+    if( arg == "-b" && i + 1 < argc ) { blockSize = atoi(argv[++i]); continue;}
+    if( arg == "-z" && i + 2 < argc ) { compAlg = atoi(argv[++i]); compLevel = atoi(argv[++i]); continue;}
+    if( arg == "-fixed" ) { isCompact = false; continue;}
+    if( arg[0] == '-' ) {
+      printf("unknown option %s\n", arg.c_str());
+      return -1;
+    }
+    Input * in = new Input();
+    in->fileName = arg;
+    in->chOffset = 0;
+    int at = in->fileName.Last('@');
+    if( at > 0 ){
+      in->chOffset = atoi(in->fileName.Data() + at + 1);
+      in->fileName.Remove(at);
+    }
+    inputs.push_back(in);
+  }
+  if( inputs.empty() ) {
+    printf("no input file.\n");
+    return -1;
+  }
+  if( nThread < 1 ) nThread = 1;
+  if( blockSize < 1 ) blockSize = 10000;
+
+  ///======= the inputs, channels and time range
+  int nChannel = 0;
+  int ch2ns = 0;
+  Long64_t nTotal = 0;
+  for( int i = 0; i < (int) inputs.size(); i++){
+    Input * in = inputs[i];
+    TFile * f = new TFile(in->fileName, "READ");
+    if( f->IsZombie() ){
+      printf("cannot open %s\n", in->fileName.Data());
+      return -1;
+    }
+    TTree * tree = (TTree *) f->Get("tree");
+    in->nEntry = tree == NULL ? 0 : tree->GetEntries();
+    in->nChannel = 16;
+    if( tree != NULL ){
+      TreeReader reader(tree);
+      in->nChannel = reader.GetNChannel();
+    }
+    TimeIndex index;
+    in->hasIndex = index.Load(f);
+    in->firstTime = in->hasIndex ? index.GetFirstTime() : 0;
+    in->lastTime  = in->hasIndex ? index.GetLastTime() : 0;
+    in->ch2ns     = in->hasIndex ? index.GetCh2ns() : 2;
+    f->Close();
+    delete f;
+
+    if( in->chOffset < 0 || in->chOffset + in->nChannel > MaxNChannels ){
+      printf("%s : channel %d to %d, more than %d channels.\n", in->fileName.Data(), in->chOffset, in->chOffset + in->nChannel - 1, MaxNChannels);
+      return -1;
+    }
+    if( in->chOffset + in->nChannel > nChannel ) nChannel = in->chOffset + in->nChannel;
+    if( ch2ns == 0 ) ch2ns = in->ch2ns;
+    if( in->ch2ns != ch2ns ) printf("%s : %d ns/ch, the output is %d ns/ch, the time stamps are not converted.\n", in->fileName.Data(), in->ch2ns, ch2ns);
+
+    in->timeShift = 0;
+    if( isSequential ){
+      if( !in->hasIndex ){
+        printf("%s has no time index, -s needs the first and the last time of every input.\n", in->fileName.Data());
+        return -1;
+      }
+      if( i > 0 ) {
+        Input * prev = inputs[i-1];
+        in->timeShift = ((Long64_t) prev->lastTime + prev->timeShift + 1) - (Long64_t) in->firstTime;
+      }
+    }
+
+    in->done = false;
+    in->nRead = 0;
+    in->nLate = 0;
+    in->current = NULL;
+    in->pos = 0;
+    nTotal += in->nEntry;
+  }
+  disorderCh = (ULong64_t) (disorderSec * 1e9 / ch2ns);
+
+  printf("******************************************** \n");
+  printf("****         BoxScore Merge             **** \n");
+  printf("******************************************** \n");
+  for( int i = 0; i < (int) inputs.size(); i++){
+    Input * in = inputs[i];
+    printf("  input %2d :\e[33m %s \e[0m, %lld events, ch %d to %d", i, in->fileName.Data(), in->nEntry, in->chOffset, in->chOffset + in->nChannel - 1);
+    if( in->hasIndex ) printf(", %.1f sec", (in->lastTime - in->firstTime) * in->ch2ns * 1e-9);
+    if( in->timeShift != 0 ) printf(", shifted %+.3f sec", in->timeShift * ch2ns * 1e-9);
+    printf("\n");
+  }
+  printf("   save to :\e[33m %s \e[0m, %d channels, %d ns/ch\n", outFileName.Data(), nChannel, ch2ns);
+  printf("   disorder %.2f sec, %d events per block, %d threads for the histograms\n", disorderSec, blockSize, nThread);
+  printf("******************************************** \n");
+
+  FileIO * file = new FileIO(outFileName);
+  file->SetCompression(compAlg, compLevel, 32000, 0);
+  file->SetTreeSchema(isCompact, false, false);
+  file->SetTree("tree", nChannel);
+  file->SetTimeIndex(1., ch2ns);
+  file->SetPersistent(true, 60, 100);
+  file->StartWriter();
+
+  vector<thread> readers;
+  for( int i = 0; i < (int) inputs.size(); i++) readers.push_back(thread(ReadInput, inputs[i]));
+
+  ///======= k-way merge by the earliest hit of the event
+  typedef pair<ULong64_t, int> Head;
+  priority_queue<Head, vector<Head>, greater<Head> > heap;
+  for( int i = 0; i < (int) inputs.size(); i++){
+    if( NextBlock(inputs[i]) ) heap.push(Head(inputs[i]->current->firstTime[0], i));
+  }
+
+  int       channel[MaxNChannels];
+  UInt_t    energy[MaxNChannels];
+  ULong64_t timeStamp[MaxNChannels];
+  UShort_t  fineTime[MaxNChannels];
+
+  time_t t0 = time(NULL);
+  time_t lastPrint = t0;
+  ULong64_t nSaved = 0, nDisorder = 0, lastTime = 0;
+  EventBatch * batch = file->GetFreeBatch();
+  while( !heap.empty() ){
+    Head head = heap.top();
+    heap.pop();
+    Input * in = inputs[head.second];
+    Block * b = in->current;
+    int k = in->pos;
+
+    for( int ch = 0; ch < nChannel; ch++){
+      channel[ch] = -1;
+      energy[ch] = 0;
+      timeStamp[ch] = 0;
+      fineTime[ch] = 0;
+    }
+    for( int ch = 0; ch < b->nChannel; ch++){
+      int j = k * b->nChannel + ch;
+      if( b->timeStamp[j] == 0 ) continue;
+      int och = ch + in->chOffset;
+      channel[och]   = och;
+      energy[och]    = b->energy[j];
+      timeStamp[och] = b->timeStamp[j];
+      fineTime[och]  = b->fineTime[j];
+    }
+    batch->Add(channel, energy, timeStamp, fineTime, 0);
+    nSaved ++;
+    if( head.first < lastTime ) nDisorder ++;
+    if( head.first > lastTime ) lastTime = head.first;
+
+    if( batch->nEvent >= blockSize ){
+      file->PushBatch(batch);
+      batch = file->GetFreeBatch();
+    }
+
+    in->pos ++;
+    if( in->pos < b->nEvent ){
+      heap.push(Head(b->firstTime[in->pos], head.second));
+    }else if( NextBlock(in) ){
+      heap.push(Head(in->current->firstTime[0], head.second));
+    }
+
+    if( time(NULL) - lastPrint >= 5 ){
+      lastPrint = time(NULL);
+      printf(" %12llu / %lld events merged, writer queue %d\r", nSaved, nTotal, file->GetQueueDepth());
+      fflush(stdout);
+    }
+  }
+  file->PushBatch(batch);
+  for( int i = 0; i < (int) readers.size(); i++) readers[i].join();
+
+  file->StopWriter();
+
+  ///======= sum the histograms of the same name and the same channel offset, by a pool of threads,
+  ///         a name found with different offsets is kept per board, boardN_name, N in the order of the offsets
+  vector<int> offsets;
+  for( int i = 0; i < (int) inputs.size(); i++) offsets.push_back(inputs[i]->chOffset);
+  sort(offsets.begin(), offsets.end());
+  offsets.erase(unique(offsets.begin(), offsets.end()), offsets.end());
+
+  vector<TString> names;
+  map<TString, map<int, vector<TH1 *> > > byName; /// name, offset
+  for( int i = 0; i < (int) inputs.size(); i++){
+    for( int j = 0; j < (int) inputs[i]->histograms.size(); j++){
+      TH1 * h = inputs[i]->histograms[j];
+      if( byName.find(h->GetName()) == byName.end() ) names.push_back(h->GetName());
+      byName[h->GetName()][inputs[i]->chOffset].push_back(h);
+    }
+  }
+
+  vector<vector<TH1 *> > groups;
+  int nPerBoard = 0;
+  for( int i = 0; i < (int) names.size(); i++){
+    map<int, vector<TH1 *> > &byOffset = byName[names[i]];
+    if( byOffset.size() > 1 ) nPerBoard ++;
+    for( map<int, vector<TH1 *> >::iterator it = byOffset.begin(); it != byOffset.end(); it++){
+      if( byOffset.size() > 1 ){
+        int board = lower_bound(offsets.begin(), offsets.end(), it->first) - offsets.begin();
+        it->second[0]->SetName(Form("board%d_%s", board, names[i].Data()));
+      }
+      groups.push_back(it->second);
+    }
+  }
+
+  vector<TH1 *> sums(groups.size(), NULL);
+  atomic<int> nextGroup(0);
+  atomic<int> nBadSum(0);
+  auto Sum = [&](){
+    while( true ){
+      int i = nextGroup ++;
+      if( i >= (int) groups.size() ) return;
+      vector<TH1 *> &list = groups[i];
+      for( int j = 1; j < (int) list.size(); j++){
+        if( !list[0]->Add(list[j]) ) nBadSum ++; /// different binning
+      }
+      sums[i] = list[0];
+    }
+  };
+  vector<thread> pool;
+  int nPool = min(nThread, (int) groups.size());
+  for( int i = 0; i < nPool; i++) pool.push_back(thread(Sum));
+  for( int i = 0; i < (int) pool.size(); i++) pool[i].join();
+
+  for( int i = 0; i < (int) sums.size(); i++) file->WriteHistogram((TObject *) sums[i]);
+
+  ///======= the setting macros, a different one of the same name is kept as name_input
+  int nMacro = 0;
+  map<TString, TString> macroText;
+  for( int i = 0; i < (int) inputs.size(); i++){
+    for( int j = 0; j < (int) inputs[i]->macros.size(); j++){
+      TMacro * macro = inputs[i]->macros[j];
+      TString name = macro->GetName();
+      TString text = MacroText(macro);
+      if( macroText.find(name) != macroText.end() ){
+        if( macroText[name] == text ) continue;
+        macro->SetName(Form("%s_%d", name.Data(), i));
+      }else{
+        macroText[name] = text;
+      }
+      file->WriteHistogram((TObject *) macro);
+      nMacro ++;
+    }
+  }
+
+  file->Close();
+
+  ///======= summary
+  double dt = difftime(time(NULL), t0);
+  printf("\n============== done in %.0f sec, %.2f Mevent/s\n", dt, dt > 0 ? nSaved / dt / 1e6 : 0.);
+  for( int i = 0; i < (int) inputs.size(); i++){
+    printf(" input %2d : %lld events read", i, inputs[i]->nRead);
+    if( inputs[i]->nLate > 0 ) printf(", %llu late ( more than %.2f sec out of order, increase -d )", inputs[i]->nLate, disorderSec);
+    printf("\n");
+  }
+  printf(" events     : %llu saved", nSaved);
+  if( nDisorder > 0 ) printf(", %llu out of time order", nDisorder);
+  printf("\n");
+  printf(" histograms : %d", (int) sums.size());
+  if( nBadSum > 0 ) printf(", %d not summed ( different binning )", (int) nBadSum);
+  if( nPerBoard > 0 ) printf(", %d kept per board ( boardN_name, different channel offsets )", nPerBoard);
+  printf("\n");
+  printf(" macros     : %d\n", nMacro);
+
+  delete file;
+  for( int i = 0; i < (int) inputs.size(); i++){
+    for( int j = 0; j < (int) inputs[i]->histograms.size(); j++) delete inputs[i]->histograms[j];
+    for( int j = 0; j < (int) inputs[i]->macros.size(); j++) delete inputs[i]->macros[j];
+    delete inputs[i];
+  }
+  return 0;
+}
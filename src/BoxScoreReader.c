@@ -8,8 +8,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <math.h>
 #include <pthread.h>
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <map>
 #include <fstream>
 #include <string>
 #include <vector>
@@ -45,27 +50,135 @@
 #include "../Class/HelioTarget.h"
 //#include "../Class/IsoDetect.h"
 #include "../Class/HelioArray.h"
+#include "../Class/TreeReader.h"
+#include "../Class/TimeIndex.h"
+#include "../Class/SettingJournal.h"
+#include "../Class/FileSnapshot.h"
+#include "../Class/ReplayCache.h"
 
 using namespace std;
 
-#define MaxNChannels 8
-
 int updatePeriod = 1000; //Table, tree, Plots update period in mili-sec.
 
+///====== time range ( -t ) and rate graph, kept from read to read in follow mode ( -f )
+bool isTimeRange = false;
+double rangeStart = 0, rangeStop = 0;
+bool isFraction = false;   /// -p, the time range as a fraction of the run
+double fractionStart = 0, fractionStop = 1;
+double disorderSec = 1.;   /// the events are written in time order within this, for the bisection without index
+ULong64_t rangeZero = 0; /// time of the first event
+int settingEpoch = -1;     /// -e, only the events of one settings epoch of the journal
+int nThread = 1;           /// -j, clusters of the tree read by threads into plane shards
+TString cutFileName = "";  /// -c, the cuts of the plane
+bool isReplayCache = true; /// -n to read the file again
+
+ULong64_t timeZero = 0;
+ULong64_t oldTime = 0;
+Double_t timeDiff = 0;
+Int_t rateCount = 0;
+
+ULong64_t initTimeStamp = 0;
+ULong64_t finalTimeStamp = 0;
+
+double ch2sec = 2e-9; /// 1 ch = 2 ns, from the time index of the file when it has one
+
 /* ###########################################################################
 *  Functions
 *  ########################################################################### */
 
+///====== a thread of the parallel read, its own file and plane, the rate in seconds from rangeZero
+struct Shard{
+  GenericPlane * gp;
+  map<Long64_t, ULong64_t> hitPerSec;
+  map<Long64_t, vector<int> > cutPerSec; /// events inside each cut, by the second of the event
+  vector<int> cutBefore;
+  Long64_t nEvent;
+};
+
 long get_time();
+GenericPlane * MakePlane(string location, bool withCanvas);
+void ProcessEvent(GenericPlane * gp, UInt_t * e, ULong64_t * t, int nChannel);
+Long64_t ProcessBlocks(GenericPlane * gp, TreeReader * reader, Long64_t first, Long64_t last); /// [first, last), returns the entries read
+Long64_t ReadEntries(GenericPlane * gp, TString fileName, Long64_t first, Long64_t last); /// [first, last), last < 0 = all, returns the next entry
+void ShardEvent(Shard * shard, UInt_t * e, ULong64_t * t, int nChannel);
+Long64_t ProcessParallel(GenericPlane * gp, string location, TString rootFile, TTree * tree, Long64_t first, Long64_t last);
+void Follow(GenericPlane * gp, TString rootFile);
 
 /* ########################################################################### */
 /* MAIN                                                                        */
 /* ########################################################################### */
 int main(int argc, char *argv[]){
 
+  ///------ -f, follow a run being written
+  bool isFollow = false;
+  for( int i = 1; i < argc; i++){
+    if( strcmp(argv[i], "-f") != 0 ) continue;
+    isFollow = true;
+    for( int j = i; j + 1 < argc; j++) argv[j] = argv[j+1];
+    argc -= 1;
+    break;
+  }
+
+  ///------ -t start stop, time range in sec from the first event, anywhere in the arguments
+  for( int i = 1; i < argc; i++){
+    if( strcmp(argv[i], "-t") != 0 || i + 2 >= argc ) continue;
+    isTimeRange = true;
+    rangeStart = atof(argv[i+1]);
+    rangeStop = atof(argv[i+2]);
+    for( int j = i; j + 3 < argc; j++) argv[j] = argv[j+3];
+    argc -= 3;
+    break;
+  }
+
+  ///------ -p from to, time range as a fraction of the run, e.g. 0.9 1 for the last tenth
+  for( int i = 1; i < argc; i++){
+    if( strcmp(argv[i], "-p") != 0 || i + 2 >= argc ) continue;
+    isFraction = true;
+    fractionStart = atof(argv[i+1]);
+    fractionStop = atof(argv[i+2]);
+    for( int j = i; j + 3 < argc; j++) argv[j] = argv[j+3];
+    argc -= 3;
+    break;
+  }
+
+  ///------ -e epoch, the events between two settings changes
+  for( int i = 1; i < argc; i++){
+    if( strcmp(argv[i], "-e") != 0 || i + 1 >= argc ) continue;
+    settingEpoch = atoi(argv[i+1]);
+    for( int j = i; j + 2 < argc; j++) argv[j] = argv[j+2];
+    argc -= 2;
+    break;
+  }
+
+  ///------ -j nThread, parallel read
+  for( int i = 1; i < argc; i++){
+    if( strcmp(argv[i], "-j") != 0 || i + 1 >= argc ) continue;
+    nThread = atoi(argv[i+1]);
+    if( nThread < 1 ) nThread = 1;
+    for( int j = i; j + 2 < argc; j++) argv[j] = argv[j+2];
+    argc -= 2;
+    break;
+  }
+
+  ///------ -c cutFile, -n no replay cache
+  for( int i = 1; i < argc; i++){
+    if( strcmp(argv[i], "-c") != 0 || i + 1 >= argc ) continue;
+    cutFileName = argv[i+1];
+    for( int j = i; j + 2 < argc; j++) argv[j] = argv[j+2];
+    argc -= 2;
+    break;
+  }
+  for( int i = 1; i < argc; i++){
+    if( strcmp(argv[i], "-n") != 0 ) continue;
+    isReplayCache = false;
+    for( int j = i; j + 1 < argc; j++) argv[j] = argv[j+1];
+    argc -= 1;
+    break;
+  }
+
   if( argc != 3 && argc != 4 ) {
     printf("usage:\n");
-    printf("$./BoxScoreReader [rootFile] [location] \n");
+    printf("$./BoxScoreReader [rootFile] [location] (-t start stop) (-p from to) (-e epoch) (-j nThread) (-c cutFile) (-n) (-f) \n");
     printf("                                  | \n");
     printf("                                  +-- testing (all ch) \n");
     printf("                                  +-- exit (dE = 0 ch, E = 3 ch)\n");
@@ -74,45 +187,39 @@ int main(int argc, char *argv[]){
     printf("                                  +-- XY (Helios target XY) \n");
     //    printf("                                  +-- iso (isomer with Glover Ge detector) \n");
     printf("                                  +-- array (Helios array) \n");
+    printf("  -t start stop : only the events from start to stop sec after the first event, \n");
+    printf("                  with the timeIndex of the file, only the clusters of the range are read,\n");
+    printf("                  without, the entries of the range are found by bisection on the event time.\n");
+    printf("  -p from to    : the time range as a fraction of the run, e.g. -p 0.9 1 for the last tenth.\n");
+    printf("  -e epoch      : only the events of a settings epoch, 0 = until the first change of the journal.\n");
+    printf("  -j nThread    : the clusters of the tree are read by nThread threads, each into its own copy of \n");
+    printf("                  the histograms, added up at the end. The rate graph is then in 1 sec bins.\n");
+    printf("  -c cutFile    : the cuts of the plane ( cutList of CutsCreator ).\n");
+    printf("  -n            : disable the replay cache, read the file again.\n");
+    printf("  replay cache  : the histograms are saved in base.location.replay.root and given back at the next\n");
+    printf("                  run of the same file, plane and selection, only the cut histograms are re-filled\n");
+    printf("                  when only the cut file changed.\n");
+    printf("  -f            : follow the run being written, the new events of every snapshot ( generalSetting.txt ) \n");
+    printf("                  are read and the plots updated, until the run ends.\n");
     return -1;
   }
 
   TString rootFile = argv[1];
   string location = argv[2];
 
+  if( nThread > 1 ) ROOT::EnableThreadSafety(); /// every thread opens the file
+
   TApplication app ("app", &argc, argv); /// this must be before Plane class, and this would change argc and argv value;
 
   //############ The Class Selection should be the only thing change
-  GenericPlane * gp = NULL ;
-
-  ///------Initialize the ChannelMask and histogram setting
-  if( location == "testing") {
-    gp = new GenericPlane();
-    gp->SetChannelMask(1,1,1,1,1,1,1,1);
+  GenericPlane * gp = MakePlane(location, true);
+  if( gp == NULL ){
+    printf("unknown location %s\n", location.c_str());
+    return -1;
+  }
+  if( location == "testing" ) {
     printf(" testing ### dE = ch-0, E = ch-4 \n");
     printf(" testing ### output file is test.root \n");
-    gp->SetdEEChannels(0, 4);
-  }else if( location == "exit") {
-    gp = new GenericPlane();
-    gp->SetChannelMask(0,0,0,0,1,0,0,1);
-    gp->SetdEEChannels(0, 3);
-    gp->SetNChannelForRealEvent(2);
-  }else if ( location == "cross" ) {
-    gp = new GenericPlane();
-    gp->SetChannelMask(0,0,0,1,0,0,1,0);
-    gp->SetdEEChannels(1, 4);
-    gp->SetNChannelForRealEvent(2);
-  }else if ( location == "ZD" ) {
-    gp = new GenericPlane();
-    gp->SetChannelMask(0,0,1,0,0,1,0,0);
-    gp->SetdEEChannels(2, 5);
-    gp->SetNChannelForRealEvent(2);
-  }else if ( location == "XY" ) {
-    gp = new HeliosTarget();
-    //}else if ( location == "iso" ) {
-    //gp = new IsoDetect();
-  }else if ( location == "array"){
-    gp = new HelioArray();
   }
 
 
@@ -137,96 +244,144 @@ int main(int argc, char *argv[]){
   if( gp->GetClassID() != 0  ) gp->SetOthersHistograms();
 
   //====== load cut and Draw
-  //gp->LoadCuts("cutsFile.root");
+  if( cutFileName != "" ) gp->LoadCuts(cutFileName);
   //gp->Draw();
 
   /* *************************************************************************************** */
   /* Readout                                                                                 */
   /* *************************************************************************************** */
 
-  TFile * file = new TFile(rootFile);
-  TTree * tree = (TTree *) file->Get("tree");
-
-  tree->SetBranchStatus("*",0);
-  tree->SetBranchStatus("e",1);
-  tree->SetBranchStatus("t",1);
-
-  UInt_t    e[MaxNChannels]; TBranch * b_energy;
-  ULong64_t t[MaxNChannels]; TBranch * b_timeStamp;
+  if( isFollow ){
+    Follow(gp, rootFile);
 
-  tree->SetBranchAddress("e", e, &b_energy);
-  tree->SetBranchAddress("t", t, &b_timeStamp);
-
-  int totalEvent = tree->GetEntries();
+    double timeSpan = (finalTimeStamp - initTimeStamp) * ch2sec;
+    printf("Total time span : %f sec \n", timeSpan);
+    printf("============================== Ctrl+C to exit.\n");
+    gp->Draw();
+    app.Run();
+    return 0;
+  }
 
-  printf("Number of event : %d \n", totalEvent);
+  TFile * file = new TFile(rootFile);
+  TTree * tree = (TTree *) file->Get("tree");
 
-  ULong64_t timeZero = 0;
-  ULong64_t oldTime = 0;
-  ULong64_t timeEnd = 0;
+  TreeReader * reader = new TreeReader(tree); /// fixed or compact schema
 
-  Double_t timeDiff;
-  Int_t count = 0;
+  Long64_t totalEvent = tree->GetEntries();
 
-  ULong64_t initTimeStamp = 0;
-  ULong64_t finalTimeStamp = 0;
+  printf("Number of event : %lld \n", totalEvent);
 
-  for(int ev = 0; ev < totalEvent; ev++){
-    tree->GetEntry(ev);
+  TimeIndex * timeIndex = new TimeIndex();
+  bool hasIndex = timeIndex->Load(file);
+  if( hasIndex ) ch2sec = timeIndex->GetCh2ns() * 1e-9;
 
-    gp->Fill(e,t);
+  ///------ time span, from the first and the last entry only
+  bool hasSpan = reader->GetTimeSpan(initTimeStamp, finalTimeStamp);
+  if( hasSpan ) printf("Time span : %.1f sec \n", (finalTimeStamp - initTimeStamp) * ch2sec);
+  if( isFraction && hasSpan ){
+    double span = (finalTimeStamp - initTimeStamp) * ch2sec;
+    isTimeRange = true;
+    rangeStart = fractionStart * span;
+    rangeStop = fractionStop * span;
+    printf("Fraction of the run : %.3f - %.3f \n", fractionStart, fractionStop);
+  }
 
-    //Get inital TimeStamp
-    if( ev == 0 ){
-      for( int j = 0; j < MaxNChannels; j++){
-        if( t[j] > 0 ) initTimeStamp = t[j];
+  ///------ time range, the entries from the time index, or by bisection when the file has none
+  Long64_t firstEntry = 0, lastEntry = totalEvent - 1;
+  if( isTimeRange ){
+    printf("Time range : %.1f - %.1f sec \n", rangeStart, rangeStop);
+    if( hasIndex ){
+      rangeZero = timeIndex->GetFirstTime();
+      if( !timeIndex->GetEntryRange(rangeStart, rangeStop, firstEntry, lastEntry) ){
+        printf("no event in the range, the run is %.1f sec.\n", timeIndex->GetLengthSec());
+        firstEntry = 0;
+        lastEntry = -1;
       }
-    }
-
-    //Get final TimeStamp
-    if( ev == totalEvent-1 ){
-      for( int j = 0; j < MaxNChannels; j++){
-        if( t[j] > 0 ) finalTimeStamp = t[j];
+      printf("   from the time index ( %.1f sec buckets ) : entry %lld - %lld, %llu events \n",
+              timeIndex->GetBucketSec(), firstEntry, lastEntry, timeIndex->GetEventCount(rangeStart, rangeStop));
+      for( int i = 0; i < timeIndex->GetNCut(); i++){
+        printf("   cut %-10s : %llu \n", timeIndex->GetCutName(i).Data(), timeIndex->GetCutCount(i, rangeStart, rangeStop));
       }
+    }else if( hasSpan ){
+      /// widened by the disorder, the exact cut is on every event
+      rangeZero = initTimeStamp;
+      Long64_t disorder = (Long64_t) (disorderSec / ch2sec);
+      Long64_t tStart = (Long64_t) initTimeStamp + (Long64_t) (rangeStart / ch2sec) - disorder;
+      Long64_t tStop  = (Long64_t) initTimeStamp + (Long64_t) (rangeStop / ch2sec) + disorder;
+      long searchTime = get_time();
+      firstEntry = reader->FindEntry(tStart > 0 ? tStart : 0, 0, totalEvent);
+      lastEntry  = reader->FindEntry(tStop, firstEntry, totalEvent) - 1;
+      printf("   no time index, by bisection : entry %lld - %lld, in %ld ms \n", firstEntry, lastEntry, get_time() - searchTime);
+    }else{
+      printf("   no event time in the file, scan all events.\n");
     }
+  }
 
-    //Recalculate rate graph
-    for( int j = 0; j < MaxNChannels; j++){
-      if( t[j] == 0 ) continue;
-      count ++;
-
-      //printf(" %llu, %llu, %llu, %f, %d\n", timeZero, oldTime, t[j], timeDiff, count);
-
-      if( timeZero == 0 ) timeZero = t[j];
-
-      if( ev == totalEvent -1 ) timeEnd = t[j];
-
-      if( oldTime == 0 ) {
-        oldTime = t[j];
-      }else{
-        if( t[j] > oldTime ) timeDiff = (t[j] - oldTime) * 2e-9; // 1ch = 2 ns; ns to sec;
-        if( t[j] < oldTime ) timeDiff = (oldTime - t[j]) * 2e-9; // 1ch = 2 ns; ns to sec;
-        if ( timeDiff > 1.00 && t[j] > timeZero){
-
-          //printf("%16llu, %16llu, %f, %f, %d \n", t[j], oldTime, timeDiff, timeSet, count);
-
-          double timeSet = (t[j] - timeZero) * 2e-9;
-          gp->FillRateGraph( timeSet, count/timeDiff);
-          oldTime = t[j];
-          count = 0;
-
-        }
-      }
+  ///------ settings journal, the changes made during the run
+  SettingJournal * journal = new SettingJournal();
+  if( journal->Load(file) ) journal->Print();
+  if( settingEpoch >= 0 ){
+    /// the journal counts the events of the whole run, the entries of a rollover segment start at firstEvent
+    ULong64_t segmentFirst = 0;
+    TParameter<Long64_t> * parFirst = (TParameter<Long64_t> *) tree->GetUserInfo()->FindObject("firstEvent");
+    bool isKnownFirst = true;
+    if( parFirst != NULL ){
+      segmentFirst = parFirst->GetVal();
+    }else if( rootFile.EndsWith(".root") && rootFile.Length() > 9 && rootFile[rootFile.Length() - 9] == '_'
+                && TString(rootFile(rootFile.Length() - 8, 3)).IsDigit() && !rootFile.EndsWith("_000.root") ){
+      isKnownFirst = false; /// a later segment of an older file, without firstEvent
     }
+    ULong64_t epochFirst = 0, epochLast = 0;
+    if( !isKnownFirst ){
+      printf("Settings epoch : %s is a later rollover segment without its first event, -e only on the first segment.\n", rootFile.Data());
+      lastEntry = firstEntry - 1;
+    }else if( journal->GetEpochRange(settingEpoch, epochFirst, epochLast) && epochLast >= segmentFirst ){
+      Long64_t first = epochFirst > segmentFirst ? epochFirst - segmentFirst : 0;
+      if( first > firstEntry ) firstEntry = first;
+      if( epochLast - segmentFirst < (ULong64_t) lastEntry ) lastEntry = epochLast - segmentFirst;
+      printf("Settings epoch %d : entry %lld - %lld \n", settingEpoch, firstEntry, lastEntry);
+    }else{
+      printf("Settings epoch %d has no event in this file ( %d changes in the journal ).\n", settingEpoch, journal->GetN());
+      lastEntry = firstEntry - 1;
+    }
+  }
+  if( lastEntry >= firstEntry && lastEntry - firstEntry + 1 < totalEvent ) tree->SetCacheEntryRange(firstEntry, lastEntry + 1);
+
+  ///------ replay cache, the histograms of the same selection
+  ReplayCache * cache = NULL;
+  int cacheState = ReplayCache::Miss;
+  if( isReplayCache ){
+    TString selection;
+    selection.Form("%lld-%lld:%d:%g-%g:%s", firstEntry, lastEntry, isTimeRange, rangeStart, rangeStop, nThread > 1 ? "parallel" : "serial");
+    cache = new ReplayCache(rootFile, location, cutFileName, selection);
+    cacheState = cache->Load(gp);
+    if( cacheState == ReplayCache::Hit ) printf("Replay cache : %s, nothing changed, not read again.\n", cache->GetFileName().Data());
+    if( cacheState == ReplayCache::CutChanged ) {
+      printf("Replay cache : %s, the cuts changed, only the cut histograms are filled.\n", cache->GetFileName().Data());
+      gp->SetCutOnly(true);
+    }
+  }
 
-
-    //if( ev%10000 == 0 ) {
-    //  for( int j = 0; j < MaxNChannels; j++){printf("%u, ", e[j]);};
-    //  printf("----- %d \n", ev);
-    //}
+  long startTime = get_time();
+  Long64_t nRead = 0;
+  if( cacheState == ReplayCache::Hit ){
+    /// every histogram is from the cache
+  }else if( nThread > 1 && lastEntry >= firstEntry ){
+    if( rangeZero == 0 ){ /// the shards need the same time zero, the first event as in the serial read
+      reader->GetEntry(firstEntry);
+      rangeZero = reader->GetFirstTimeStamp();
+    }
+    nRead = ProcessParallel(gp, location, rootFile, tree, firstEntry, lastEntry + 1);
+  }else{
+    nRead = ProcessBlocks(gp, reader, firstEntry, lastEntry + 1);
   }
+  long readTime = get_time() - startTime;
+  printf("Read %lld events in %.1f sec, %.2f Mevent/s \n", nRead, readTime / 1000., readTime > 0 ? nRead / (readTime * 1000.) : 0.);
+
+  gp->SetCutOnly(false);
+  if( cache != NULL && cacheState != ReplayCache::Hit ) cache->Save(gp);
 
-  double timeSpan = (finalTimeStamp - initTimeStamp) * 2e-9;
+  double timeSpan = (finalTimeStamp - initTimeStamp) * ch2sec;
   printf("Total time span : %f sec \n", timeSpan);
   printf("                : %f min \n", timeSpan/60.);
   printf("                : %f hour \n", timeSpan/60./60.);
@@ -254,3 +409,306 @@ long get_time(){
   time_ms = (t1.tv_sec) * 1000 + t1.tv_usec / 1000;
   return time_ms;
 }
+
+GenericPlane * MakePlane(string location, bool withCanvas){
+
+  GenericPlane * gp = NULL ;
+
+  ///------Initialize the ChannelMask and histogram setting
+  if( location == "testing") {
+    gp = new GenericPlane(withCanvas);
+    gp->SetChannelMask(1,1,1,1,1,1,1,1);
+    gp->SetdEEChannels(0, 4);
+  }else if( location == "exit") {
+    gp = new GenericPlane(withCanvas);
+    gp->SetChannelMask(0,0,0,0,1,0,0,1);
+    gp->SetdEEChannels(0, 3);
+    gp->SetNChannelForRealEvent(2);
+  }else if ( location == "cross" ) {
+    gp = new GenericPlane(withCanvas);
+    gp->SetChannelMask(0,0,0,1,0,0,1,0);
+    gp->SetdEEChannels(1, 4);
+    gp->SetNChannelForRealEvent(2);
+  }else if ( location == "ZD" ) {
+    gp = new GenericPlane(withCanvas);
+    gp->SetChannelMask(0,0,1,0,0,1,0,0);
+    gp->SetdEEChannels(2, 5);
+    gp->SetNChannelForRealEvent(2);
+  }else if ( location == "XY" ) {
+    gp = new HeliosTarget(withCanvas);
+    //}else if ( location == "iso" ) {
+    //gp = new IsoDetect();
+  }else if ( location == "array"){
+    gp = new HelioArray(withCanvas);
+  }
+
+  return gp;
+}
+
+void ProcessEvent(GenericPlane * gp, UInt_t * e, ULong64_t * t, int nChannel){
+
+  if( rangeZero == 0 ){ /// no time index, the first event
+    for( int j = 0; j < nChannel; j++){
+      if( t[j] > 0 && (rangeZero == 0 || t[j] < rangeZero) ) rangeZero = t[j];
+    }
+  }
+
+  if( isTimeRange ){ /// the buckets are coarse, cut exactly on the event time
+    ULong64_t tEvent = 0;
+    for( int j = 0; j < nChannel; j++){
+      if( t[j] > 0 && (tEvent == 0 || t[j] < tEvent) ) tEvent = t[j];
+    }
+    double tSec = tEvent > rangeZero ? (tEvent - rangeZero) * ch2sec : 0;
+    if( tSec < rangeStart || tSec > rangeStop ) return;
+  }
+
+  gp->Fill(e,t);
+
+  //Recalculate rate graph
+  for( int j = 0; j < nChannel; j++){
+    if( t[j] == 0 ) continue;
+    rateCount ++;
+
+    //printf(" %llu, %llu, %llu, %f, %d\n", timeZero, oldTime, t[j], timeDiff, rateCount);
+
+    if( timeZero == 0 ) timeZero = t[j];
+
+    if( oldTime == 0 ) {
+      oldTime = t[j];
+    }else{
+      if( t[j] > oldTime ) timeDiff = (t[j] - oldTime) * ch2sec;
+      if( t[j] < oldTime ) timeDiff = (oldTime - t[j]) * ch2sec;
+      if ( timeDiff > 1.00 && t[j] > timeZero){
+
+        //printf("%16llu, %16llu, %f, %f, %d \n", t[j], oldTime, timeDiff, timeSet, rateCount);
+
+        double timeSet = (t[j] - timeZero) * ch2sec;
+        gp->FillRateGraph( timeSet, rateCount/timeDiff);
+        oldTime = t[j];
+        rateCount = 0;
+
+      }
+    }
+  }
+}
+
+Long64_t ProcessBlocks(GenericPlane * gp, TreeReader * reader, Long64_t first, Long64_t last){
+  /// a cluster at a time, column by column, then the events of the block to the plane
+  const int nChannel = reader->GetNChannel();
+  const int slot = reader->GetSlot();
+  Long64_t ev = first;
+  while( ev < last ){
+    int n = reader->ReadBlock(ev, last);
+    if( n <= 0 ) break;
+    UInt_t    * e = reader->GetBlockEnergy();
+    ULong64_t * t = reader->GetBlockTimeStamp();
+    for( int i = 0; i < n; i++) ProcessEvent(gp, e + (size_t) i * slot, t + (size_t) i * slot, nChannel);
+    ev += n;
+  }
+  return ev - first;
+}
+
+void ShardEvent(Shard * shard, UInt_t * e, ULong64_t * t, int nChannel){
+
+  ULong64_t tEvent = 0;
+  for( int j = 0; j < nChannel; j++){
+    if( t[j] > 0 && (tEvent == 0 || t[j] < tEvent) ) tEvent = t[j];
+  }
+  if( isTimeRange ){
+    double tSec = tEvent > rangeZero ? (tEvent - rangeZero) * ch2sec : 0;
+    if( tSec < rangeStart || tSec > rangeStop ) return;
+  }
+
+  int nCut = shard->gp->GetNumCut();
+  for( int i = 0; i < nCut; i++) shard->cutBefore[i] = shard->gp->GetCountOfCut(i);
+  shard->gp->Fill(e,t);
+  shard->nEvent ++;
+
+  for( int i = 0; i < nCut; i++){
+    int delta = shard->gp->GetCountOfCut(i) - shard->cutBefore[i];
+    if( delta == 0 ) continue;
+    vector<int> &count = shard->cutPerSec[(Long64_t) floor(((Long64_t) (tEvent - rangeZero)) * ch2sec)];
+    if( count.empty() ) count.assign(nCut, 0);
+    count[i] += delta;
+  }
+
+  for( int j = 0; j < nChannel; j++){
+    if( t[j] == 0 ) continue;
+    Long64_t sec = (Long64_t) floor(((Long64_t) (t[j] - rangeZero)) * ch2sec);
+    shard->hitPerSec[sec] ++;
+  }
+}
+
+Long64_t ProcessParallel(GenericPlane * gp, string location, TString rootFile, TTree * tree, Long64_t first, Long64_t last){
+
+  ///------ the clusters of the range, handed out one by one, so a slow thread does not hold the others
+  vector<Long64_t> clusterStart;
+  TTree::TClusterIterator it = tree->GetClusterIterator(first);
+  Long64_t start = it.Next();
+  while( start < last ){
+    clusterStart.push_back(start > first ? start : first);
+    start = it.Next();
+    if( start <= clusterStart.back() ) break; /// no more cluster
+  }
+  clusterStart.push_back(last);
+
+  ///------ the shards, no canvas, the histograms not in gROOT, so the threads do not share anything
+  vector<Shard *> shards;
+  TH1::AddDirectory(kFALSE);
+  for( int i = 0; i < nThread; i++){
+    Shard * shard = new Shard();
+    shard->gp = MakePlane(location, false);
+    shard->gp->SetGenericHistograms();
+    if( shard->gp->GetClassID() != 0 ) shard->gp->SetOthersHistograms();
+    if( cutFileName != "" ) shard->gp->LoadCuts(cutFileName);
+    shard->gp->SetCutOnly(gp->IsCutOnly());
+    shard->cutBefore.assign(shard->gp->GetNumCut(), 0);
+    shard->nEvent = 0;
+    shards.push_back(shard);
+  }
+  TH1::AddDirectory(kTRUE);
+
+  printf("Read %d clusters with %d threads \n", (int) clusterStart.size() - 1, nThread);
+
+  atomic<int> nextCluster(0);
+  auto Work = [&](Shard * shard){
+    TFile * file = new TFile(rootFile, "READ");
+    TTree * t = (TTree *) file->Get("tree");
+    TreeReader * reader = new TreeReader(t);
+    const int nChannel = reader->GetNChannel();
+    const int slot = reader->GetSlot();
+    while( true ){
+      int c = nextCluster ++;
+      if( c + 1 >= (int) clusterStart.size() ) break;
+      t->SetCacheEntryRange(clusterStart[c], clusterStart[c+1]);
+      Long64_t ev = clusterStart[c];
+      while( ev < clusterStart[c+1] ){
+        int n = reader->ReadBlock(ev, clusterStart[c+1]);
+        if( n <= 0 ) break;
+        UInt_t    * e  = reader->GetBlockEnergy();
+        ULong64_t * ts = reader->GetBlockTimeStamp();
+        for( int i = 0; i < n; i++) ShardEvent(shard, e + (size_t) i * slot, ts + (size_t) i * slot, nChannel);
+        ev += n;
+      }
+    }
+    delete reader;
+    file->Close();
+    delete file;
+  };
+
+  vector<thread> workers;
+  for( int i = 0; i < nThread; i++) workers.push_back(thread(Work, shards[i]));
+  for( int i = 0; i < nThread; i++) workers[i].join();
+
+  ///------ merge, the histograms and the rate graph
+  int nCut = gp->GetNumCut();
+  vector<int> cutTotal(nCut);
+  for( int i = 0; i < nCut; i++) cutTotal[i] = gp->GetCountOfCut(i);
+  Long64_t nEvent = 0;
+  map<Long64_t, ULong64_t> hitPerSec;
+  map<Long64_t, vector<int> > cutPerSec;
+  for( int i = 0; i < nThread; i++){
+    Shard * shard = shards[i];
+    gp->MergeShard(shard->gp);
+    for( map<Long64_t, ULong64_t>::iterator p = shard->hitPerSec.begin(); p != shard->hitPerSec.end(); p++) hitPerSec[p->first] += p->second;
+    for( map<Long64_t, vector<int> >::iterator p = shard->cutPerSec.begin(); p != shard->cutPerSec.end(); p++){
+      vector<int> &count = cutPerSec[p->first];
+      if( count.empty() ) count.assign(nCut, 0);
+      for( int k = 0; k < nCut && k < (int) p->second.size(); k++) count[k] += p->second[k];
+    }
+    nEvent += shard->nEvent;
+    delete shard->gp;
+    delete shard;
+  }
+
+  /// replay in time order, the cut rate graphs take the cut counts up to each second, as the serial read
+  map<Long64_t, vector<int> >::iterator c = cutPerSec.begin();
+  for( map<Long64_t, ULong64_t>::iterator p = hitPerSec.begin(); p != hitPerSec.end(); p++){
+    for( ; c != cutPerSec.end() && c->first <= p->first; c++){
+      for( int k = 0; k < nCut; k++) cutTotal[k] += c->second[k];
+    }
+    for( int k = 0; k < nCut; k++) gp->SetCountOfCut(k, cutTotal[k]);
+    gp->FillRateGraph( p->first + 1, p->second); /// at the end of the second, as the serial read
+  }
+  for( ; c != cutPerSec.end(); c++){
+    for( int k = 0; k < nCut; k++) cutTotal[k] += c->second[k];
+  }
+  for( int k = 0; k < nCut; k++) gp->SetCountOfCut(k, cutTotal[k]);
+
+  printf("%lld events in the range \n", nEvent);
+  return last - first;
+}
+
+Long64_t ReadEntries(GenericPlane * gp, TString fileName, Long64_t first, Long64_t last){
+
+  /// a fresh open, the tree header is the one of the latest AutoSave
+  TFile * file = new TFile(fileName, "READ");
+  if( file->IsZombie() ) {
+    delete file;
+    return first;
+  }
+  TTree * tree = (TTree *) file->Get("tree");
+  if( tree == NULL ) { /// no AutoSave yet, try at the next snapshot
+    file->Close();
+    delete file;
+    return first;
+  }
+
+  Long64_t nEntry = tree->GetEntries();
+  if( last < 0 || last > nEntry ) last = nEntry;
+
+  TreeReader * reader = new TreeReader(tree);
+  if( initTimeStamp == 0 ) initTimeStamp = reader->GetEntryTime(0, 1);
+  if( last > first ){
+    ULong64_t t = reader->GetEntryTime(last - 1, -1); /// the time span from the ends of what is read
+    if( t > finalTimeStamp ) finalTimeStamp = t;
+    ProcessBlocks(gp, reader, first, last);
+  }
+  delete reader;
+
+  file->Close();
+  delete file;
+  return last > first ? last : first;
+}
+
+void Follow(GenericPlane * gp, TString rootFile){
+
+  TString snapshotName = FileSnapshot::GetName(rootFile);
+  printf("Follow : %s \n", snapshotName.Data());
+
+  FileSnapshot snapshot;
+  TString currentFile = "";
+  Long64_t nextEntry = 0;
+  Long64_t totalRead = 0;
+  long lastPoll = 0;
+
+  while( true ){
+    gSystem->ProcessEvents(); /// keep the canvas alive between the polls
+    if( get_time() - lastPoll < updatePeriod ) {
+      usleep(10000);
+      continue;
+    }
+    lastPoll = get_time();
+
+    if( !snapshot.Read(snapshotName) ) continue; /// the run has not started yet
+
+    if( snapshot.fileName != currentFile ){
+      if( currentFile != "" ) totalRead += ReadEntries(gp, currentFile, nextEntry, -1) - nextEntry; /// the rest of the closed segment
+      currentFile = snapshot.fileName;
+      nextEntry = 0;
+      printf("Follow : %s \n", currentFile.Data());
+    }
+
+    if( snapshot.entries > nextEntry ){
+      Long64_t read = ReadEntries(gp, currentFile, nextEntry, snapshot.entries);
+      totalRead += read - nextEntry;
+      nextEntry = read;
+      printf("\r events : %lld, time span : %.1f sec ", totalRead, (finalTimeStamp - initTimeStamp) * ch2sec);
+      fflush(stdout);
+      gp->Draw();
+    }
+
+    if( snapshot.isEnd && nextEntry >= snapshot.entries ) break;
+  }
+  printf("\nThe run is over.\n");
+}
@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <pthread.h>
 #include <thread>
 #include <fstream>
@@ -24,6 +25,9 @@
 #include <TString.h>
 #include <TObjArray.h>
 
+#include "../Class/TreeReader.h"
+#include "../Class/TimeIndex.h"
+
 using namespace std;
 
 TFile * cutFile = NULL ;
@@ -32,12 +36,26 @@ TObjArray * cutList = NULL;
 
 int main(int argc, char* argv[] ){
 
+  ///------ -t start stop, time range in sec from the first event, anywhere in the arguments
+  bool isTimeRange = false;
+  double rangeStart = 0, rangeStop = 0;
+  for( int i = 1; i < argc; i++){
+    if( strcmp(argv[i], "-t") != 0 || i + 2 >= argc ) continue;
+    isTimeRange = true;
+    rangeStart = atof(argv[i+1]);
+    rangeStop = atof(argv[i+2]);
+    for( int j = i; j + 3 < argc; j++) argv[j] = argv[j+3];
+    argc -= 3;
+    break;
+  }
+
   if( argc != 9 && argc != 10  && argc != 12) {
     //printf("Please input channel for dE and E. \n");
     printf("./CutCreator [rootFile] [opt] [chDE] [chE] [rangeDE_min]\n");
     printf("[rangeDE_max] [rangeE_min rangeE_max] [mode] [gainDE] [gainE]\n");
     printf("                          | \n");
     printf("                          + opt = recreate / update \n");
+    printf("  -t start stop : only the events from start to stop sec after the first event ( timeIndex of the file ) \n");
     return 0;
   }
 
@@ -105,11 +123,27 @@ int main(int argc, char* argv[] ){
           1000,
           (int) rangeDE_min,
           (int) rangeDE_max);
-    expression.Form("e[%d]:e[%d]>>hEdE",
-    chDE, chEE);
+    expression.Form("%s:%s>>hEdE",
+    TreeReader::EnergyExpression(tree, chDE).Data(), TreeReader::EnergyExpression(tree, chEE).Data()); /// fixed or compact schema
   // }
 
-  tree->Draw(expression, "", "colz");
+  ///------ time range, with the granularity of the time index buckets
+  Long64_t firstEntry = 0, nEntry = tree->GetEntries();
+  if( isTimeRange ){
+    TimeIndex timeIndex;
+    Long64_t lastEntry = -1;
+    if( !timeIndex.Load(fileIn) ){
+      printf("no time index in %s, all events are used.\n", rootFile.c_str());
+    }else if( timeIndex.GetEntryRange(rangeStart, rangeStop, firstEntry, lastEntry) ){
+      nEntry = lastEntry - firstEntry + 1;
+      printf("time range %.1f - %.1f sec : entry %lld - %lld \n", rangeStart, rangeStop, firstEntry, lastEntry);
+    }else{
+      printf("no event in %.1f - %.1f sec, the run is %.1f sec.\n", rangeStart, rangeStop, timeIndex.GetLengthSec());
+      nEntry = 0;
+    }
+  }
+
+  tree->Draw(expression, "", "colz", nEntry, firstEntry);
 
   // make cuts
   TString cutFileName = "data/cutsFile.root";
@@ -0,0 +1,399 @@
+/******************************************************************************
+*  This program re-builds events from the raw hit stream of BoxScore (.raw),
+*  with the same coincidence logic as Digitizer::BuildEvent, but with any
+*  coincident window, trigger condition and channel time offsets.
+*  The output is the usual "tree" of BoxScore.
+*
+*  The hits are cut into chunks of data time, the chunks are sorted and built
+*  by a pool of threads. A chunk is built from its first gap wider than the
+*  window to its last one, where the grouping does not depend on the other
+*  chunks, the hits around the cuts are built in order by the main thread,
+*  so the result is the same as a single pass over the whole run.
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+
+#include "TROOT.h"
+#include "TString.h"
+#include "TFile.h"
+#include "TTree.h"
+
+#include "../Class/RawHitFormat.h"
+#include "../Class/FileIO.h"
+
+using namespace std;
+
+#define MaxNChannels 16
+#define FineTimeBits 10
+
+//============ the rebuild setting
+int       nChannel = MaxNChannels;
+int       ch2ns = 2;
+ULong64_t windowHR;                    /// ns x 2^FineTimeBits, as in BuildEvent
+int       minHit = 1;                  /// multiplicity of an event to be kept
+unsigned int trgMask = 0;              /// an event must have a hit in these channels, 0 = any
+Long64_t  offsetHR[MaxNChannels];      /// added to the time stamp, fine-ch
+
+//============ a chunk of data time
+struct Chunk{
+  Long64_t index;
+  vector<RawHit> hits;
+  int gapFirst;               /// first hit after a gap >= window, -1 if no gap
+  int gapLast;                /// last hit after a gap >= window
+  EventBatch * interior;      /// events of [gapFirst, gapLast)
+  ULong64_t multiplicity[MaxNChannels + 1];
+  ULong64_t rejected;
+  bool done;
+};
+
+mutex jobMutex;
+condition_variable jobCond;
+condition_variable doneCond;
+deque<Chunk *> jobs;
+bool jobStop = false;
+
+FileIO * file;
+
+/* ###########################################################################
+*  Functions
+*  ########################################################################### */
+
+bool HitOrder(const RawHit &a, const RawHit &b){
+  if( a.timeStamp != b.timeStamp ) return a.timeStamp < b.timeStamp;
+  return a.channel < b.channel;
+}
+
+bool IsGap(const RawHit * hits, int i){ /// no event can hold both hits[i-1] and hits[i]
+  return (hits[i].timeStamp - hits[i-1].timeStamp) * ch2ns >= windowHR;
+}
+
+/// group the time-ordered hits [start, end) as Digitizer::BuildEvent does
+void Build(const RawHit * hits, int start, int end, EventBatch * batch, ULong64_t * multiplicity, ULong64_t &rejected){
+
+  int       channel[MaxNChannels];
+  UInt_t    energy[MaxNChannels];
+  ULong64_t timeStamp[MaxNChannels];
+  UShort_t  fineTime[MaxNChannels];
+
+  for( int i = start; i < end; i++){
+
+    int numRawEventGrouped = 0;
+    for( int j = i + 1; j < end; j++){
+      if( (hits[j].timeStamp - hits[i].timeStamp) * ch2ns >= windowHR ) break;
+      numRawEventGrouped ++;
+    }
+
+    int nHit = numRawEventGrouped + 1;
+    multiplicity[nHit > MaxNChannels ? MaxNChannels : nHit] ++;
+
+    bool triggered = (trgMask == 0);
+    for( int j = i ; j <= i + numRawEventGrouped ; j++) if( trgMask & (1 << hits[j].channel) ) triggered = true;
+
+    if( nHit < minHit || !triggered ){
+      rejected ++;
+      i += numRawEventGrouped;
+      continue;
+    }
+
+    for( int k = 0; k < nChannel; k++){
+      channel[k] = -1;
+      energy[k] = 0;
+      timeStamp[k] = 0;
+      fineTime[k] = 0;
+    }
+    for( int j = i ; j <= i + numRawEventGrouped ; j++){ /// same channel twice, the later one is kept, as online
+      int ch = hits[j].channel;
+      channel[ch]   = ch;
+      energy[ch]    = hits[j].energy;
+      timeStamp[ch] = hits[j].timeStamp >> FineTimeBits;
+      fineTime[ch]  = hits[j].timeStamp & ((1 << FineTimeBits) - 1);
+    }
+    batch->Add(channel, energy, timeStamp, fineTime, 0);
+
+    i += numRawEventGrouped;
+  }
+}
+
+void Worker(){
+  while( true ){
+    Chunk * chunk = NULL;
+    {
+      unique_lock<mutex> lock(jobMutex);
+      jobCond.wait(lock, []{ return !jobs.empty() || jobStop; });
+      if( jobs.empty() ) return;
+      chunk = jobs.front();
+      jobs.pop_front();
+    }
+
+    stable_sort(chunk->hits.begin(), chunk->hits.end(), HitOrder); /// ties stay in read-out order
+
+    const RawHit * hits = chunk->hits.data();
+    int n = chunk->hits.size();
+    chunk->gapFirst = -1;
+    chunk->gapLast = -1;
+    for( int i = 1; i < n; i++) if( IsGap(hits, i) ) { chunk->gapFirst = i; break; }
+    for( int i = n - 1; i > chunk->gapFirst && chunk->gapFirst > 0; i--) if( IsGap(hits, i) ) { chunk->gapLast = i; break; }
+    if( chunk->gapFirst > 0 && chunk->gapLast < 0 ) chunk->gapLast = chunk->gapFirst;
+
+    chunk->interior = file->GetFreeBatch();
+    if( chunk->gapFirst > 0 ) Build(hits, chunk->gapFirst, chunk->gapLast, chunk->interior, chunk->multiplicity, chunk->rejected);
+
+    {
+      lock_guard<mutex> lock(jobMutex);
+      chunk->done = true;
+    }
+    doneCond.notify_all();
+  }
+}
+
+void LoadOffsets(string fileName){
+  ifstream in(fileName.c_str());
+  if( !in.is_open() ){
+    printf("cannot open offset file %s, no offset.\n", fileName.c_str());
+    return;
+  }
+  string line;
+  while( getline(in, line) ){
+    if( line.empty() || line[0] == '#' || line.substr(0, 2) == "//" ) continue;
+    int ch;
+    double offset;
+    if( sscanf(line.c_str(), "%d %lf", &ch, &offset) != 2 ) continue;
+    if( ch < 0 || ch >= MaxNChannels ) continue;
+    offsetHR[ch] = llround(offset / ch2ns * (1 << FineTimeBits));
+    printf("   offset ch %2d : %8.2f ns\n", ch, offset);
+  }
+}
+
+/* ########################################################################### */
+/* MAIN                                                                        */
+/* ########################################################################### */
+int main(int argc, char *argv[]){
+
+  if( argc < 3 ) {
+    printf("usage:\n");
+    printf("$./EventRebuilder [rawFile] [rootFile] (window ns) (options)\n");
+    printf("           window : coincident window in ns, default = the one of the run\n");
+    printf("     -j  nThread  : number of threads, default = all cores\n");
+    printf("     -m  nHit     : keep events with at least nHit hits, default 1\n");
+    printf("     -c  mask     : keep events with a hit in the channel mask (hex), default 0 = any\n");
+    printf("     -o  file     : channel time offsets, lines of \"ch offset_ns\"\n");
+    printf("     -s  sec      : chunk length in data time, default 1\n");
+    printf("     -d  sec      : maximum time disorder of the raw stream, default 1\n");
+    printf("     -z  alg lvl  : compression, 1 ZLIB, 2 LZMA, 4 LZ4, 5 ZSTD, default 4 1\n");
+    printf("     -fixed       : fixed ch/e/t/tf[NChannel] schema, default compact\n");
+    return -1;
+  }
+
+  ROOT::EnableThreadSafety();
+
+  TString rawFileName = argv[1];
+  TString rootFileName = argv[2];
+
+  RawHitReader reader;
+  if( !reader.Open(rawFileName) ) return -1;
+  RawHitFileHeader header = reader.GetHeader();
+  if( header.fineTimeBits != FineTimeBits ){
+    printf("raw file fine time bits %u, expected %d.\n", header.fineTimeBits, FineTimeBits);
+    return -1;
+  }
+  nChannel = header.nChannel > 0 && header.nChannel <= MaxNChannels ? header.nChannel : MaxNChannels;
+  ch2ns = header.ch2ns > 0 ? header.ch2ns : 2;
+
+  int window = header.coincidentTimeWindow;
+  int nThread = thread::hardware_concurrency();
+  double chunkSec = 1.;
+  double disorderSec = 1.;
+  int compAlg = 4, compLevel = 1;
+  bool isCompact = true;
+  string offsetFile = "";
+  for( int i = 0; i < MaxNChannels; i++) offsetHR[i] = 0;
+
+  for( int i = 3; i < argc; i++){
+    string arg = argv[i];
+    if( arg == "-j" && i + 1 < argc ) { nThread = atoi(argv[++i]); continue;}
+    if( arg == "-m" && i + 1 < argc ) { minHit = atoi(argv[++i]); continue;}
+    if( arg == "-c" && i + 1 < argc ) { trgMask = strtoul(argv[++i], NULL, 16); continue;}
+    if( arg == "-o" && i + 1 < argc ) { offsetFile = argv[++i]; continue;}
+    if( arg == "-s" && i + 1 < argc ) { chunkSec = atof(argv[++i]); continue;}
+    if( arg == "-d" && i + 1 < argc ) { disorderSec = atof(argv[++i]); continue;}
+    if( arg == "-z" && i + 2 < argc ) { compAlg = atoi(argv[++i]); compLevel = atoi(argv[++i]); continue;}
+    if( arg == "-fixed" ) { isCompact = false; continue;}
+    if( i == 3 ) { window = atoi(argv[i]); continue;}
+    printf("unknown option %s\n", arg.c_str());
+    return -1;
+  }
+  if( nThread < 1 ) nThread = 1;
+  if( chunkSec <= 0 ) chunkSec = 1.;
+  windowHR = ((ULong64_t) window) << FineTimeBits;
+
+  printf("******************************************** \n");
+  printf("****         BoxScore Event Rebuilder   **** \n");
+  printf("******************************************** \n");
+  printf("   raw file :\e[33m %s \e[0m, board %d, %d ch, mask 0x%04X, %d ns/ch\n", rawFileName.Data(), header.serialNumber, nChannel, header.channelMask, ch2ns);
+  printf("    save to :\e[33m %s \e[0m\n", rootFileName.Data());
+  printf("     window :\e[33m %d ns \e[0m ( run : %u ns ), min hit %d, trigger mask 0x%04X\n", window, header.coincidentTimeWindow, minHit, trgMask);
+  printf("    threads : %d, chunk %.2f sec, disorder %.2f sec\n", nThread, chunkSec, disorderSec);
+  if( offsetFile != "" ) LoadOffsets(offsetFile);
+  printf("******************************************** \n");
+
+  file = new FileIO(rootFileName);
+  file->SetCompression(compAlg, compLevel, 32000, 0);
+  file->SetTreeSchema(isCompact, false, false);
+  file->SetTree("tree", nChannel);
+  file->SetTimeIndex(1., ch2ns);
+  file->SetPersistent(true, 60, 100);
+  file->StartWriter();
+
+  vector<thread> workers;
+  for( int i = 0; i < nThread; i++) workers.push_back(thread(Worker));
+
+  const ULong64_t chunkHR    = (ULong64_t) (chunkSec * 1e9 / ch2ns) << FineTimeBits;
+  const ULong64_t disorderHR = (ULong64_t) (disorderSec * 1e9 / ch2ns) << FineTimeBits;
+
+  map<Long64_t, vector<RawHit> > open;   /// chunk index -> hits, not yet handed to the workers
+  deque<Chunk *> inFlight;               /// time ordered
+  Long64_t nextIndex = 0;                /// hits of an earlier chunk are too late
+  ULong64_t maxTime = 0;
+
+  vector<RawHit> carry;                  /// hits after the last gap, built with the next chunk
+  ULong64_t multiplicity[MaxNChannels + 1] = {0};
+  ULong64_t rejected = 0, nPileUp = 0, nLate = 0, nBadChannel = 0, nHitUsed = 0, nSaved = 0;
+
+  ///======= build the hits around the cut, in time order, and hand the events to the writer
+  auto Merge = [&](Chunk * chunk){
+    {
+      unique_lock<mutex> lock(jobMutex);
+      doneCond.wait(lock, [chunk]{ return chunk->done; });
+    }
+
+    int cut = chunk->gapFirst > 0 ? chunk->gapFirst : chunk->hits.size();
+    carry.insert(carry.end(), chunk->hits.begin(), chunk->hits.begin() + cut);
+
+    if( chunk->gapFirst > 0 ){
+      EventBatch * seam = file->GetFreeBatch();
+      Build(carry.data(), 0, carry.size(), seam, multiplicity, rejected);
+      nSaved += seam->nEvent + chunk->interior->nEvent;
+      file->PushBatch(seam);
+      file->PushBatch(chunk->interior);
+      carry.assign(chunk->hits.begin() + chunk->gapLast, chunk->hits.end());
+    }else{
+      file->PushBatch(chunk->interior); /// empty
+    }
+
+    for( int k = 0; k <= MaxNChannels; k++) multiplicity[k] += chunk->multiplicity[k];
+    rejected += chunk->rejected;
+    delete chunk;
+  };
+
+  auto Dispatch = [&](Long64_t index, vector<RawHit> &hits){
+    Chunk * chunk = new Chunk();
+    chunk->index = index;
+    chunk->hits.swap(hits);
+    chunk->interior = NULL;
+    for( int k = 0; k <= MaxNChannels; k++) chunk->multiplicity[k] = 0;
+    chunk->rejected = 0;
+    chunk->done = false;
+
+    while( (int) inFlight.size() >= 2 * nThread ){ /// keep the memory bounded
+      Merge(inFlight.front());
+      inFlight.pop_front();
+    }
+    inFlight.push_back(chunk);
+    {
+      lock_guard<mutex> lock(jobMutex);
+      jobs.push_back(chunk);
+    }
+    jobCond.notify_one();
+  };
+
+  ///======= read
+  time_t t0 = time(NULL);
+  time_t lastPrint = t0;
+  vector<RawHit> block;
+  while( true ){
+    block.clear();
+    bool more = reader.ReadBlock(block);
+
+    for( int i = 0; i < (int) block.size(); i++){
+      RawHit hit = block[i];
+      if( hit.flags & RawFlagPileUp ) { nPileUp ++; continue;}
+      if( hit.channel >= nChannel ) { nBadChannel ++; continue;}
+
+      Long64_t t = (Long64_t) hit.timeStamp + offsetHR[hit.channel];
+      hit.timeStamp = t < 0 ? 0 : t;
+
+      Long64_t index = hit.timeStamp / chunkHR;
+      if( index < nextIndex ) { nLate ++; continue;}
+      open[index].push_back(hit);
+      nHitUsed ++;
+      if( hit.timeStamp > maxTime ) maxTime = hit.timeStamp;
+    }
+
+    ///------ a chunk is complete once the stream is past its end by the disorder
+    while( !open.empty() && (ULong64_t) (open.begin()->first + 1) * chunkHR + disorderHR <= maxTime ){
+      Dispatch(open.begin()->first, open.begin()->second);
+      nextIndex = open.begin()->first + 1;
+      open.erase(open.begin());
+    }
+
+    if( time(NULL) - lastPrint >= 5 ){
+      lastPrint = time(NULL);
+      printf(" %12lld hits read, %10.1f sec of data, %12llu events built, writer queue %d\r",
+                reader.GetNHitRead(), maxTime * ch2ns * 1e-9 / (1 << FineTimeBits), nSaved, file->GetQueueDepth());
+      fflush(stdout);
+    }
+
+    if( !more ) break;
+  }
+
+  for( map<Long64_t, vector<RawHit> >::iterator it = open.begin(); it != open.end(); it++) Dispatch(it->first, it->second);
+  open.clear();
+  while( !inFlight.empty() ){
+    Merge(inFlight.front());
+    inFlight.pop_front();
+  }
+
+  EventBatch * last = file->GetFreeBatch();
+  Build(carry.data(), 0, carry.size(), last, multiplicity, rejected);
+  file->PushBatch(last);
+
+  {
+    lock_guard<mutex> lock(jobMutex);
+    jobStop = true;
+  }
+  jobCond.notify_all();
+  for( int i = 0; i < (int) workers.size(); i++) workers[i].join();
+
+  file->StopWriter();
+  file->Close();
+
+  ///======= summary
+  double dt = difftime(time(NULL), t0);
+  ULong64_t nEvent = 0;
+  for( int k = 1; k <= MaxNChannels; k++) nEvent += multiplicity[k];
+  printf("\n============== done in %.0f sec, %.2f Mhit/s\n", dt, dt > 0 ? reader.GetNHitRead() / dt / 1e6 : 0.);
+  printf(" hits read   : %lld in %lld blocks\n", reader.GetNHitRead(), reader.GetNBlockRead());
+  printf(" hits used   : %llu\n", nHitUsed);
+  printf(" pile-up     : %llu ( no energy, not built )\n", nPileUp);
+  if( nBadChannel > 0 ) printf(" bad channel : %llu\n", nBadChannel);
+  if( nLate > 0 ) printf(" too late    : %llu ( more than %.2f sec out of order, increase -d )\n", nLate, disorderSec);
+  printf(" events      : %llu, %llu rejected by the trigger condition, %llu saved\n", nEvent, rejected, nEvent - rejected);
+  printf(" multiplicity:");
+  for( int k = 1; k <= MaxNChannels; k++) if( multiplicity[k] > 0 ) printf(" [%d] %llu", k, multiplicity[k]);
+  printf("\n");
+
+  delete file;
+  return 0;
+}